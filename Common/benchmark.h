@@ -0,0 +1,180 @@
+// MIT License
+// 
+// Copyright (C) 2018-2024, Tellusim Technologies Inc. https://tellusim.com/
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TELLUSIM_DEMOS_BENCHMARK_H__
+#define __TELLUSIM_DEMOS_BENCHMARK_H__
+
+#include <core/TellusimFile.h>
+#include <core/TellusimString.h>
+
+#include <algorithm>
+#include <math.h>
+
+#if _LINUX
+	#include <stdio.h>
+	#include <unistd.h>
+#endif
+
+/*
+ */
+namespace Tellusim {
+	
+	/* benchmark stage
+	 * per-frame stage timings in microseconds
+	 */
+	class BenchmarkStage {
+			
+		public:
+			
+			explicit BenchmarkStage(const char *name = nullptr) : name(name) { }
+			
+			void append(uint64_t time) { times.append(time); }
+			
+			const String &getName() const { return name; }
+			uint32_t getNumFrames() const { return times.size(); }
+			
+			uint64_t getTotal() const {
+				uint64_t ret = 0;
+				for(uint64_t time : times) ret += time;
+				return ret;
+			}
+			float64_t getMean() const {
+				if(!times) return 0.0;
+				return (float64_t)getTotal() / times.size();
+			}
+			
+			/// nearest-rank percentile
+			float64_t getPercentile(float64_t percentile) const {
+				if(!times) return 0.0;
+				Array<uint64_t> sorted = times;
+				std::sort(sorted.begin(), sorted.end());
+				uint32_t index = (uint32_t)ceil(percentile * 0.01 * sorted.size());
+				return (float64_t)sorted[clamp(index, 1u, sorted.size()) - 1];
+			}
+			
+			/// power-of-two microsecond buckets
+			Array<uint32_t> getHistogram() const {
+				Array<uint32_t> ret(NumBuckets, 0u);
+				for(uint64_t time : times) {
+					uint32_t index = 0;
+					while(time > 1 && index + 1 < NumBuckets) { time >>= 1; index++; }
+					ret[index]++;
+				}
+				while(ret.size() > 1 && ret.back() == 0) ret.removeBack();
+				return ret;
+			}
+			
+			/// JSON object in milliseconds
+			String getJSON(bool histogram = false) const {
+				String ret = String::format("\"%s\": { \"frames\": %u, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"mean\": %.4f, \"total\": %.4f", name.get(), times.size(),
+					getPercentile(50.0) / 1000.0, getPercentile(95.0) / 1000.0, getPercentile(99.0) / 1000.0, getMean() / 1000.0, getTotal() / 1000.0);
+				if(histogram) {
+					Array<uint32_t> buckets = getHistogram();
+					ret += ", \"histogram_us\": [";
+					for(uint32_t i = 0; i < buckets.size(); i++) ret += String::format((i) ? ", %u" : "%u", buckets[i]);
+					ret += "]";
+				}
+				ret += " }";
+				return ret;
+			}
+			
+		private:
+			
+			enum {
+				NumBuckets = 32,
+			};
+			
+			String name;
+			Array<uint64_t> times;
+	};
+	
+	/* process memory
+	 * resident set size in bytes or zero when it's not available
+	 */
+	static inline size_t getProcessMemory() {
+		size_t ret = 0;
+		#if _LINUX
+			FILE *file = fopen("/proc/self/statm", "rb");
+			if(file) {
+				unsigned long size = 0, resident = 0;
+				if(fscanf(file, "%lu %lu", &size, &resident) == 2) ret = (size_t)resident * sysconf(_SC_PAGESIZE);
+				fclose(file);
+			}
+		#endif
+		return ret;
+	}
+	
+	/* benchmark report
+	 * named stages saved as a single JSON object
+	 */
+	class BenchmarkReport {
+			
+		public:
+			
+			explicit BenchmarkReport(const char *name) : name(name) { }
+			
+			/// stage index by name
+			uint32_t addStage(const char *stage) {
+				stages.append(BenchmarkStage(stage));
+				return stages.size() - 1;
+			}
+			BenchmarkStage &getStage(uint32_t index) { return stages[index]; }
+			
+			void append(uint32_t index, uint64_t time) { stages[index].append(time); }
+			
+			/// report values
+			void setValue(const char *key, const char *value) { values.append(String::format("\"%s\": \"%s\"", key, value)); }
+			void setValue(const char *key, float64_t value) { values.append(String::format("\"%s\": %.4f", key, value)); }
+			
+			/// histograms are included on request
+			/// compact reports are single-line objects
+			String getJSON(bool histogram = false, bool compact = false) const {
+				const char *indent_0 = (compact) ? "" : "\t";
+				const char *indent_1 = (compact) ? "" : "\t\t";
+				const char *newline = (compact) ? " " : "\n";
+				String ret = String::format("{%s%s\"benchmark\": \"%s\",%s", newline, indent_0, name.get(), newline);
+				for(const String &value : values) ret += String(indent_0) + value + "," + newline;
+				ret += String::format("%s\"stages\": {%s", indent_0, newline);
+				for(uint32_t i = 0; i < stages.size(); i++) {
+					ret += indent_1 + stages[i].getJSON(histogram) + ((i + 1 < stages.size()) ? "," : "") + newline;
+				}
+				ret += String::format("%s}%s}\n", indent_0, newline);
+				return ret;
+			}
+			
+			/// appended reports are JSON lines
+			bool save(const char *path, bool histogram = false, bool append = false) const {
+				File file;
+				if(!file.open(path, (append) ? "ab" : "wb")) return false;
+				String json = getJSON(histogram, append);
+				return (file.write(json.get(), json.size()) == json.size());
+			}
+			
+		private:
+			
+			String name;
+			Array<String> values;
+			Array<BenchmarkStage> stages;
+	};
+}
+
+#endif /* __TELLUSIM_DEMOS_BENCHMARK_H__ */
@@ -0,0 +1,71 @@
+// MIT License
+// 
+// Copyright (C) 2018-2024, Tellusim Technologies Inc. https://tellusim.com/
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TELLUSIM_DEMOS_NAMES_H__
+#define __TELLUSIM_DEMOS_NAMES_H__
+
+#include <core/TellusimArray.h>
+
+#include <string.h>
+
+/*
+ */
+namespace Tellusim {
+	
+	/* indexed names
+	 * finds all "<prefix><number>" names in a single pass
+	 * indices are ordered by the number and stop at the first missing number
+	 */
+	template <class Func> uint32_t findIndexedNames(uint32_t num_names, const char *prefix, Func get_name, Array<uint32_t> &indices) {
+		
+		size_t length = strlen(prefix);
+		
+		indices.clear();
+		for(uint32_t i = 0; i < num_names; i++) {
+			const char *name = get_name(i);
+			if(!name || strncmp(name, prefix, length) != 0) continue;
+			
+			// name number
+			const char *s = name + length;
+			if(*s < '0' || *s > '9') continue;
+			uint32_t number = 0;
+			while(*s >= '0' && *s <= '9' && number < Maxu16) number = number * 10 + (*s++ - '0');
+			if(*s != '\0' || number >= Maxu16) continue;
+			
+			// the first name wins
+			while(indices.size() <= number) indices.append(Maxu32);
+			if(indices[number] == Maxu32) indices[number] = i;
+		}
+		
+		// first missing number
+		for(uint32_t i = 0; i < indices.size(); i++) {
+			if(indices[i] == Maxu32) {
+				indices.resize(i);
+				break;
+			}
+		}
+		
+		return indices.size();
+	}
+}
+
+#endif /* __TELLUSIM_DEMOS_NAMES_H__ */
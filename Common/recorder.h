@@ -0,0 +1,472 @@
+// MIT License
+// 
+// Copyright (C) 2018-2024, Tellusim Technologies Inc. https://tellusim.com/
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TELLUSIM_DEMOS_RECORDER_H__
+#define __TELLUSIM_DEMOS_RECORDER_H__
+
+#include <core/TellusimLog.h>
+#include <core/TellusimTime.h>
+#include <core/TellusimFile.h>
+#include <core/TellusimArray.h>
+
+#include <math.h>
+#include <string.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+/*
+ */
+namespace Tellusim {
+	
+	/* transform stream format
+	 * header: magic, number of nodes, position step, keyframe interval, origin
+	 * frame: size, time, flags, changed nodes bitmap, changed nodes data
+	 * node: zigzag varint position and scale bits deltas, smallest-three quaternion
+	 * transforms are row-major 3x4 matrices with uniform scale relative to the origin
+	 * the scale is stored as float bits, so it doesn't depend on the position step
+	 */
+	namespace TransformStream {
+		
+		enum {
+			Magic = ('T' | ('R' << 8) | ('S' << 16) | ('1' << 24)),
+			FlagKeyframe = 1 << 0,
+			MaxVarintSize = 5,
+			MaxNodeSize = MaxVarintSize * 4 + sizeof(uint32_t),
+		};
+		
+		/// largest frame data, varints of int32 differences take up to 5 bytes
+		static inline uint64_t get_max_frame_size(uint32_t num_nodes) {
+			return (num_nodes + 7) / 8 + (uint64_t)num_nodes * MaxNodeSize;
+		}
+		
+		/// quantized transform
+		struct Node {
+			int32_t position[3];
+			int32_t scale;
+			uint32_t rotation;
+			bool operator!=(const Node &node) const {
+				return (memcmp(this, &node, sizeof(Node)) != 0);
+			}
+		};
+		
+		/// smallest-three quaternion with 10 bits per component
+		static inline uint32_t encode_rotation(const float32_t *q) {
+			uint32_t index = 0;
+			for(uint32_t i = 1; i < 4; i++) {
+				if(fabsf(q[i]) > fabsf(q[index])) index = i;
+			}
+			float32_t sign = (q[index] < 0.0f) ? -1.0f : 1.0f;
+			uint32_t ret = index << 30;
+			for(uint32_t i = 0, j = 0; i < 4; i++) {
+				if(i == index) continue;
+				float32_t v = q[i] * sign * 0.70710678f + 0.5f;
+				uint32_t bits = (uint32_t)(fminf(fmaxf(v, 0.0f), 1.0f) * 1023.0f + 0.5f);
+				ret |= bits << (20 - 10 * j++);
+			}
+			return ret;
+		}
+		static inline void decode_rotation(uint32_t rotation, float32_t *q) {
+			uint32_t index = rotation >> 30;
+			float32_t sum = 0.0f;
+			for(uint32_t i = 0, j = 0; i < 4; i++) {
+				if(i == index) continue;
+				q[i] = (((rotation >> (20 - 10 * j++)) & 1023u) / 1023.0f - 0.5f) * 1.41421356f;
+				sum += q[i] * q[i];
+			}
+			q[index] = sqrtf(fmaxf(1.0f - sum, 0.0f));
+		}
+		
+		/// quantize transform
+		static inline Node encode_node(const float32_t *transform, float32_t step) {
+			Node ret;
+			float32_t istep = 1.0f / step;
+			for(uint32_t i = 0; i < 3; i++) ret.position[i] = (int32_t)floorf(transform[i * 4 + 3] * istep + 0.5f);
+			float32_t scale = sqrtf(transform[0] * transform[0] + transform[4] * transform[4] + transform[8] * transform[8]);
+			memcpy(&ret.scale, &scale, sizeof(scale));
+			float32_t iscale = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+			float32_t m00 = transform[0] * iscale, m01 = transform[1] * iscale, m02 = transform[2] * iscale;
+			float32_t m10 = transform[4] * iscale, m11 = transform[5] * iscale, m12 = transform[6] * iscale;
+			float32_t m20 = transform[8] * iscale, m21 = transform[9] * iscale, m22 = transform[10] * iscale;
+			float32_t q[4], trace = m00 + m11 + m22;
+			if(trace > 0.0f) {
+				float32_t s = 0.5f / sqrtf(trace + 1.0f);
+				q[0] = (m21 - m12) * s; q[1] = (m02 - m20) * s; q[2] = (m10 - m01) * s; q[3] = 0.25f / s;
+			} else if(m00 > m11 && m00 > m22) {
+				float32_t s = 0.5f / sqrtf(1.0f + m00 - m11 - m22);
+				q[0] = 0.25f / s; q[1] = (m01 + m10) * s; q[2] = (m02 + m20) * s; q[3] = (m21 - m12) * s;
+			} else if(m11 > m22) {
+				float32_t s = 0.5f / sqrtf(1.0f + m11 - m00 - m22);
+				q[0] = (m01 + m10) * s; q[1] = 0.25f / s; q[2] = (m12 + m21) * s; q[3] = (m02 - m20) * s;
+			} else {
+				float32_t s = 0.5f / sqrtf(1.0f + m22 - m00 - m11);
+				q[0] = (m02 + m20) * s; q[1] = (m12 + m21) * s; q[2] = 0.25f / s; q[3] = (m10 - m01) * s;
+			}
+			float32_t ilength = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+			for(uint32_t i = 0; i < 4; i++) q[i] *= ilength;
+			ret.rotation = encode_rotation(q);
+			return ret;
+		}
+		static inline void decode_node(const Node &node, float32_t step, float32_t *transform) {
+			float32_t q[4];
+			decode_rotation(node.rotation, q);
+			float32_t x = q[0], y = q[1], z = q[2], w = q[3];
+			float32_t s;
+			memcpy(&s, &node.scale, sizeof(s));
+			transform[0] = (1.0f - 2.0f * (y * y + z * z)) * s; transform[1] = 2.0f * (x * y - z * w) * s; transform[2] = 2.0f * (x * z + y * w) * s;
+			transform[4] = 2.0f * (x * y + z * w) * s; transform[5] = (1.0f - 2.0f * (x * x + z * z)) * s; transform[6] = 2.0f * (y * z - x * w) * s;
+			transform[8] = 2.0f * (x * z - y * w) * s; transform[9] = 2.0f * (y * z + x * w) * s; transform[10] = (1.0f - 2.0f * (x * x + y * y)) * s;
+			for(uint32_t i = 0; i < 3; i++) transform[i * 4 + 3] = node.position[i] * step;
+		}
+		
+		/// row-major 3x4 transform from matrix
+		template <class Matrix> static inline void get_rows(const Matrix &m, float32_t *transform) {
+			transform[0] = (float32_t)m.m00; transform[1] = (float32_t)m.m01; transform[2] = (float32_t)m.m02; transform[3] = (float32_t)m.m03;
+			transform[4] = (float32_t)m.m10; transform[5] = (float32_t)m.m11; transform[6] = (float32_t)m.m12; transform[7] = (float32_t)m.m13;
+			transform[8] = (float32_t)m.m20; transform[9] = (float32_t)m.m21; transform[10] = (float32_t)m.m22; transform[11] = (float32_t)m.m23;
+		}
+		
+		/// row-major 3x4 transform relative to the origin
+		/// the origin is subtracted with the matrix precision
+		template <class Matrix> static inline void get_rows(const Matrix &m, const float64_t *origin, float32_t *transform) {
+			get_rows(m, transform);
+			transform[3] = (float32_t)(m.m03 - origin[0]);
+			transform[7] = (float32_t)(m.m13 - origin[1]);
+			transform[11] = (float32_t)(m.m23 - origin[2]);
+		}
+		
+		/// matrix from row-major 3x4 transform
+		template <class Matrix> static inline Matrix get_matrix(const float32_t *transform) {
+			Matrix m;
+			m.m00 = transform[0]; m.m01 = transform[1]; m.m02 = transform[2]; m.m03 = transform[3];
+			m.m10 = transform[4]; m.m11 = transform[5]; m.m12 = transform[6]; m.m13 = transform[7];
+			m.m20 = transform[8]; m.m21 = transform[9]; m.m22 = transform[10]; m.m23 = transform[11];
+			return m;
+		}
+		
+		/// zigzag varints
+		static inline void write_varint(Array<uint8_t> &data, int64_t value) {
+			uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+			while(v >= 0x80) {
+				data.append((uint8_t)(v | 0x80));
+				v >>= 7;
+			}
+			data.append((uint8_t)v);
+		}
+		static inline int64_t read_varint(const uint8_t *&data, const uint8_t *end) {
+			uint64_t v = 0;
+			for(uint32_t shift = 0; data < end && shift < 64; shift += 7) {
+				uint8_t byte = *data++;
+				v |= (uint64_t)(byte & 0x7f) << shift;
+				if((byte & 0x80) == 0) break;
+			}
+			return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+		}
+	}
+	
+	/* transform recorder
+	 * frames are quantized, delta-coded, and written on a background thread
+	 */
+	class TransformRecorder {
+			
+		public:
+			
+			TransformRecorder() { }
+			~TransformRecorder() {
+				close();
+			}
+			
+			/// create stream
+			/// recorded positions are relative to the origin
+			bool open(const char *name, uint32_t num, float32_t step = 1.0f / 1024.0f, uint32_t keyframe = 256, const float64_t *origin = nullptr) {
+				close();
+				if(!file.open(name, "wb")) return false;
+				num_nodes = num;
+				position_step = step;
+				keyframe_interval = keyframe;
+				frame_index = 0;
+				state.resize(num_nodes);
+				pending.resize(num_nodes);
+				changed.resize((num_nodes + 7) / 8);
+				memset(state.get(), 0, state.bytes());
+				file.writeu32(TransformStream::Magic);
+				file.writeu32(num_nodes);
+				file.write(&position_step, sizeof(position_step));
+				file.writeu32(keyframe_interval);
+				float64_t header_origin[3] = { 0.0, 0.0, 0.0 };
+				if(origin) memcpy(header_origin, origin, sizeof(header_origin));
+				file.write(header_origin, sizeof(header_origin));
+				done = false;
+				thread = std::thread(&TransformRecorder::loop, this);
+				return true;
+			}
+			
+			/// finish stream
+			void close() {
+				if(!thread.joinable()) return;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					done = true;
+				}
+				condition.notify_all();
+				thread.join();
+				file.close();
+			}
+			
+			/// record transforms of all nodes or of the listed nodes
+			/// the other nodes keep their previous transforms
+			void record(float64_t time, const float32_t *transforms, const uint32_t *indices = nullptr, uint32_t num = 0) {
+				if(!thread.joinable()) return;
+				if(!indices) num = num_nodes;
+				
+				// wait for a free frame
+				std::unique_lock<std::mutex> lock(mutex);
+				if(frames.size() >= MaxFrames) num_stalls++;
+				condition.wait(lock, [this] { return (frames.size() < MaxFrames); });
+				Frame frame;
+				if(free_frames.size()) {
+					frame = std::move(free_frames.back());
+					free_frames.pop_back();
+				}
+				lock.unlock();
+				
+				// copy transforms
+				frame.time = time;
+				frame.transforms.resize(num * 12);
+				memcpy(frame.transforms.get(), transforms, frame.transforms.bytes());
+				frame.indices.resize((indices) ? num : 0);
+				if(indices) memcpy(frame.indices.get(), indices, frame.indices.bytes());
+				
+				lock.lock();
+				frames.push_back(std::move(frame));
+				lock.unlock();
+				condition.notify_all();
+			}
+			
+			/// stream statistics
+			uint64_t getRawBytes() const { return raw_bytes; }
+			uint64_t getEncodedBytes() const { return encoded_bytes; }
+			uint64_t getEncodeTime() const { return encode_time; }
+			uint32_t getNumStalls() const { return num_stalls; }
+			float64_t getRatio() const { return (encoded_bytes) ? (float64_t)raw_bytes / encoded_bytes : 0.0; }
+			float64_t getThroughput() const { return (encode_time) ? raw_bytes / (float64_t)encode_time : 0.0; }
+			
+		private:
+			
+			enum {
+				MaxFrames = 4,
+			};
+			
+			struct Frame {
+				float64_t time = 0.0;
+				Array<float32_t> transforms;
+				Array<uint32_t> indices;
+			};
+			
+			// recorder thread loop
+			void loop() {
+				std::unique_lock<std::mutex> lock(mutex);
+				while(true) {
+					condition.wait(lock, [this] { return (frames.size() || done); });
+					if(frames.empty()) break;
+					Frame frame = std::move(frames.front());
+					frames.pop_front();
+					lock.unlock();
+					condition.notify_all();
+					encode(frame);
+					lock.lock();
+					free_frames.push_back(std::move(frame));
+				}
+			}
+			
+			// encode frame
+			void encode(const Frame &frame) {
+				
+				using namespace TransformStream;
+				
+				uint64_t begin = Time::current();
+				bool keyframe = (keyframe_interval && frame_index % keyframe_interval == 0);
+				frame_index++;
+				
+				// quantize transforms
+				// keyframes contain all nodes
+				memcpy(pending.get(), state.get(), state.bytes());
+				memset(changed.get(), (keyframe) ? 0xff : 0x00, changed.bytes());
+				uint32_t num = (frame.indices) ? frame.indices.size() : num_nodes;
+				for(uint32_t i = 0; i < num; i++) {
+					uint32_t index = (frame.indices) ? frame.indices[i] : i;
+					if(index >= num_nodes) continue;
+					pending[index] = encode_node(frame.transforms.get() + i * 12, position_step);
+					if(pending[index] != state[index]) changed[index >> 3] |= (uint8_t)(1u << (index & 7));
+				}
+				
+				// changed nodes
+				data.clear();
+				data.append(changed.get(), changed.size());
+				for(uint32_t i = 0; i < num_nodes; i++) {
+					if((changed[i >> 3] & (1u << (i & 7))) == 0) continue;
+					const Node &node = pending[i];
+					const Node &base = (keyframe) ? zero : state[i];
+					for(uint32_t j = 0; j < 3; j++) write_varint(data, (int64_t)node.position[j] - base.position[j]);
+					write_varint(data, (int64_t)node.scale - base.scale);
+					data.append((uint8_t*)&node.rotation, sizeof(node.rotation));
+					state[i] = node;
+				}
+				
+				// write frame
+				uint32_t flags = (keyframe) ? FlagKeyframe : 0;
+				file.writeu32(data.size());
+				file.write(&frame.time, sizeof(frame.time));
+				file.writeu32(flags);
+				file.write(data.get(), data.size());
+				
+				raw_bytes += num * sizeof(float32_t) * 12;
+				encoded_bytes += data.size() + sizeof(uint32_t) * 2 + sizeof(float64_t);
+				encode_time += Time::current() - begin;
+			}
+			
+			File file;
+			uint32_t num_nodes = 0;
+			float32_t position_step = 0.0f;
+			uint32_t keyframe_interval = 0;
+			uint32_t frame_index = 0;
+			
+			TransformStream::Node zero = {};
+			Array<TransformStream::Node> state;
+			Array<TransformStream::Node> pending;
+			Array<uint8_t> changed;
+			Array<uint8_t> data;
+			
+			std::thread thread;
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::deque<Frame> frames;
+			std::deque<Frame> free_frames;
+			bool done = false;
+			
+			uint64_t raw_bytes = 0;
+			uint64_t encoded_bytes = 0;
+			uint64_t encode_time = 0;
+			uint32_t num_stalls = 0;
+	};
+	
+	/* transform reader
+	 * replays recorded frames without running the simulation
+	 */
+	class TransformReader {
+			
+		public:
+			
+			/// open stream
+			bool open(const char *name) {
+				if(!file.open(name, "rb")) return false;
+				if(file.readu32() != TransformStream::Magic) return false;
+				num_nodes = file.readu32();
+				if(file.read(&position_step, sizeof(position_step)) != sizeof(position_step)) return false;
+				file.readu32();
+				if(file.read(origin, sizeof(origin)) != sizeof(origin)) return false;
+				offset = sizeof(uint32_t) * 4 + sizeof(origin);
+				file_size = file.getSize();
+				state.resize(num_nodes);
+				memset(state.get(), 0, state.bytes());
+				transforms.resize(num_nodes * 12);
+				return true;
+			}
+			
+			/// read next frame
+			/// returns false at the end of the stream or after an invalid frame
+			bool read(float64_t &time) {
+				
+				using namespace TransformStream;
+				
+				// frame header
+				constexpr uint32_t header_size = sizeof(uint32_t) * 2 + sizeof(time);
+				if(offset + header_size > file_size) return false;
+				uint32_t size = file.readu32();
+				if(file.read(&time, sizeof(time)) != sizeof(time)) return stop("truncated frame header");
+				uint32_t flags = file.readu32();
+				offset += header_size;
+				
+				// frame size must fit the remaining bytes and the largest encoded frame
+				if(size == 0 || size > file_size - offset || size > get_max_frame_size(num_nodes)) return stop("invalid frame size");
+				data.resize(size);
+				if(file.read(data.get(), size) != size) return stop("truncated frame data");
+				offset += size;
+				
+				// changed nodes
+				changed.clear();
+				uint32_t bitmap_size = (num_nodes + 7) / 8;
+				if(size < bitmap_size) return stop("invalid frame bitmap");
+				const uint8_t *src = data.get() + bitmap_size;
+				const uint8_t *end = data.get() + size;
+				Node zero = {};
+				for(uint32_t i = 0; i < num_nodes; i++) {
+					if((data[i >> 3] & (1u << (i & 7))) == 0) continue;
+					Node &node = state[i];
+					const Node base = (flags & FlagKeyframe) ? zero : node;
+					for(uint32_t j = 0; j < 3; j++) node.position[j] = (int32_t)(base.position[j] + read_varint(src, end));
+					node.scale = (int32_t)(base.scale + read_varint(src, end));
+					if(src + sizeof(node.rotation) > end) return stop("invalid frame data");
+					memcpy(&node.rotation, src, sizeof(node.rotation));
+					src += sizeof(node.rotation);
+					decode_node(node, position_step, transforms.get() + i * 12);
+					changed.append(i);
+				}
+				
+				return true;
+			}
+			
+			uint32_t getNumNodes() const { return num_nodes; }
+			
+			/// origin of the recorded positions
+			const float64_t *getOrigin() const { return origin; }
+			
+			/// nodes changed by the last frame
+			const Array<uint32_t> &getChanged() const { return changed; }
+			
+			/// row-major 3x4 transform relative to the origin
+			const float32_t *getTransform(uint32_t index) const { return transforms.get() + index * 12; }
+			
+		private:
+			
+			/// stop the replay, the remaining frames are not read
+			bool stop(const char *error) {
+				TS_LOGF(Error, "TransformReader::read(): %s at %llu\n", error, (unsigned long long)offset);
+				offset = file_size;
+				return false;
+			}
+			
+			File file;
+			uint64_t offset = 0;
+			uint64_t file_size = 0;
+			uint32_t num_nodes = 0;
+			float32_t position_step = 0.0f;
+			float64_t origin[3] = { 0.0, 0.0, 0.0 };
+			Array<TransformStream::Node> state;
+			Array<float32_t> transforms;
+			Array<uint32_t> changed;
+			Array<uint8_t> data;
+	};
+}
+
+#endif /* __TELLUSIM_DEMOS_RECORDER_H__ */
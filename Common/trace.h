@@ -0,0 +1,198 @@
+// MIT License
+// 
+// Copyright (C) 2018-2024, Tellusim Technologies Inc. https://tellusim.com/
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TELLUSIM_DEMOS_TRACE_H__
+#define __TELLUSIM_DEMOS_TRACE_H__
+
+#include <core/TellusimTime.h>
+#include <core/TellusimFile.h>
+#include <core/TellusimString.h>
+
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_set>
+#include <string>
+
+/*
+ */
+namespace Tellusim {
+	
+	/* timeline trace
+	 * scoped zones are recorded into per-thread ring buffers and saved as Chrome trace JSON
+	 * tracing is enabled by the TRACE environment variable or by Trace::setEnabled()
+	 */
+	class Trace {
+			
+		public:
+			
+			/// trace event
+			struct Event {
+				const char *name;
+				uint64_t begin;
+				uint64_t end;
+			};
+			
+			/// runtime switch
+			static bool isEnabled() { return get_enabled().load(std::memory_order_relaxed); }
+			static void setEnabled(bool enabled) { get_enabled().store(enabled, std::memory_order_relaxed); }
+			
+			/// complete event from the current thread
+			static void append(const char *name, uint64_t begin, uint64_t end) {
+				Buffer &buffer = get_buffer();
+				uint64_t size = buffer.size.load(std::memory_order_relaxed);
+				buffer.events[size & (BufferSize - 1)] = { name, begin, end };
+				buffer.size.store(size + 1, std::memory_order_release);
+			}
+			
+			/// nested zones for bindings without scopes
+			static void begin(const char *name) {
+				Buffer &buffer = get_buffer();
+				if(buffer.depth < MaxDepth) {
+					buffer.stack[buffer.depth].name = name;
+					buffer.stack[buffer.depth].begin = Time::current();
+				}
+				buffer.depth++;
+			}
+			static void end() {
+				Buffer &buffer = get_buffer();
+				if(buffer.depth == 0) return;
+				if(--buffer.depth < MaxDepth) append(buffer.stack[buffer.depth].name, buffer.stack[buffer.depth].begin, Time::current());
+			}
+			
+			/// persistent zone names for dynamic strings
+			static const char *intern(const char *name) {
+				Names &names = get_names();
+				std::lock_guard<std::mutex> lock(names.mutex);
+				return names.names.insert(name).first->c_str();
+			}
+			
+			/// Chrome trace JSON
+			/// buffers should not be written while saving
+			static String getJSON() {
+				Buffers &buffers = get_buffers();
+				std::lock_guard<std::mutex> lock(buffers.mutex);
+				String ret = "{ \"traceEvents\": [\n";
+				bool first = true;
+				for(const std::unique_ptr<Buffer> &buffer : buffers.buffers) {
+					uint64_t size = buffer->size.load(std::memory_order_acquire);
+					for(uint64_t i = (size > BufferSize) ? size - BufferSize : 0; i < size; i++) {
+						const Event &event = buffer->events[i & (BufferSize - 1)];
+						ret += String::format("%s{ \"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %llu, \"dur\": %llu }", (first) ? "" : ",\n",
+							event.name, buffer->thread, (unsigned long long)event.begin, (unsigned long long)(event.end - event.begin));
+						first = false;
+					}
+				}
+				ret += "\n] }\n";
+				return ret;
+			}
+			
+			static bool save(const char *path) {
+				File file;
+				if(!file.open(path, "wb")) return false;
+				String json = getJSON();
+				return (file.write(json.get(), json.size()) == json.size());
+			}
+			
+		private:
+			
+			enum {
+				BufferSize = 1 << 16,
+				MaxDepth = 64,
+			};
+			
+			struct Buffer {
+				uint32_t thread = 0;
+				std::atomic<uint64_t> size = { 0 };
+				uint32_t depth = 0;
+				Event stack[MaxDepth];
+				Event events[BufferSize];
+			};
+			
+			struct Buffers {
+				std::mutex mutex;
+				std::vector<std::unique_ptr<Buffer>> buffers;
+			};
+			
+			struct Names {
+				std::mutex mutex;
+				std::unordered_set<std::string> names;
+			};
+			
+			static std::atomic<bool> &get_enabled() {
+				static std::atomic<bool> enabled = { getenv("TRACE") != nullptr };
+				return enabled;
+			}
+			
+			static Buffers &get_buffers() {
+				static Buffers buffers;
+				return buffers;
+			}
+			
+			static Names &get_names() {
+				static Names names;
+				return names;
+			}
+			
+			// buffers are allocated on the first event of the thread
+			static Buffer &get_buffer() {
+				thread_local Buffer *buffer = nullptr;
+				if(!buffer) {
+					Buffers &buffers = get_buffers();
+					std::lock_guard<std::mutex> lock(buffers.mutex);
+					buffers.buffers.emplace_back(new Buffer());
+					buffer = buffers.buffers.back().get();
+					buffer->thread = (uint32_t)buffers.buffers.size();
+				}
+				return *buffer;
+			}
+	};
+	
+	/* trace zone
+	 * disabled zones cost a single relaxed load
+	 */
+	class TraceZone {
+			
+		public:
+			
+			explicit TraceZone(const char *name) : name(name), begin(Trace::isEnabled() ? Time::current() : 0) { }
+			~TraceZone() {
+				if(begin) Trace::append(name, begin, Time::current());
+			}
+			
+		private:
+			
+			const char *name;
+			uint64_t begin;
+	};
+}
+
+/*
+ */
+#define TRACE_CONCAT_(A, B)	A ## B
+#define TRACE_CONCAT(A, B)	TRACE_CONCAT_(A, B)
+#define TRACE_ZONE(NAME)	Tellusim::TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(NAME)
+
+#endif /* __TELLUSIM_DEMOS_TRACE_H__ */
@@ -0,0 +1,150 @@
+// MIT License
+// 
+// Copyright (C) 2018-2024, Tellusim Technologies Inc. https://tellusim.com/
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TELLUSIM_DEMOS_WORKERS_H__
+#define __TELLUSIM_DEMOS_WORKERS_H__
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+/*
+ */
+namespace Tellusim {
+	
+	/* worker pool
+	 * persistent threads which are woken for each job
+	 * the calling thread takes part in the job and returns when all items are processed
+	 */
+	class WorkerPool {
+			
+		public:
+			
+			WorkerPool() { }
+			~WorkerPool() {
+				release();
+			}
+			
+			WorkerPool(const WorkerPool&) = delete;
+			WorkerPool &operator=(const WorkerPool&) = delete;
+			
+			/// create worker threads
+			/// the number of threads includes the calling thread
+			void create(uint32_t num_threads) {
+				release();
+				terminate = false;
+				for(uint32_t i = 1; i < num_threads; i++) {
+					threads.emplace_back(&WorkerPool::loop, this);
+				}
+			}
+			
+			/// release worker threads
+			void release() {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					terminate = true;
+				}
+				start_condition.notify_all();
+				for(std::thread &thread : threads) thread.join();
+				threads.clear();
+			}
+			
+			uint32_t getNumThreads() const { return (uint32_t)threads.size() + 1; }
+			
+			/// run func(index) for each index in the [0, num) range
+			template <class Func> void run(uint32_t num, const Func &func) {
+				
+				// single thread
+				if(threads.empty() || num < 2) {
+					for(uint32_t i = 0; i < num; i++) func(i);
+					return;
+				}
+				
+				// workers from the previous job can still be running
+				std::unique_lock<std::mutex> lock(mutex);
+				done_condition.wait(lock, [this] { return (num_busy == 0); });
+				job_data = &func;
+				job_func = [](const void *data, uint32_t index) { (*(const Func*)data)(index); };
+				job_size = num;
+				job_index.store(0, std::memory_order_relaxed);
+				generation++;
+				lock.unlock();
+				start_condition.notify_all();
+				
+				// process items on the calling thread
+				process(job_func, job_data, job_size);
+				
+				// wait for workers
+				lock.lock();
+				done_condition.wait(lock, [this] { return (num_busy == 0); });
+			}
+			
+		private:
+			
+			using JobFunc = void(*)(const void *data, uint32_t index);
+			
+			// worker thread loop
+			// the job is copied under the lock, so a late worker never mixes two jobs
+			void loop() {
+				std::unique_lock<std::mutex> lock(mutex);
+				uint32_t current = generation;
+				while(true) {
+					start_condition.wait(lock, [&] { return (terminate || generation != current); });
+					if(terminate) break;
+					current = generation;
+					JobFunc func = job_func;
+					const void *data = job_data;
+					uint32_t size = job_size;
+					num_busy++;
+					lock.unlock();
+					process(func, data, size);
+					lock.lock();
+					if(--num_busy == 0) done_condition.notify_all();
+				}
+			}
+			
+			void process(JobFunc func, const void *data, uint32_t size) {
+				while(true) {
+					uint32_t index = job_index.fetch_add(1, std::memory_order_relaxed);
+					if(index >= size) break;
+					func(data, index);
+				}
+			}
+			
+			std::vector<std::thread> threads;
+			std::mutex mutex;
+			std::condition_variable start_condition;
+			std::condition_variable done_condition;
+			bool terminate = false;
+			uint32_t generation = 0;
+			uint32_t num_busy = 0;
+			
+			JobFunc job_func = nullptr;
+			const void *job_data = nullptr;
+			uint32_t job_size = 0;
+			std::atomic<uint32_t> job_index = { 0 };
+	};
+}
+
+#endif /* __TELLUSIM_DEMOS_WORKERS_H__ */
@@ -20,12 +20,95 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <core/TellusimFile.h>
+#include <core/TellusimTime.h>
 #include <format/TellusimMesh.h>
 
+#include "../Common/benchmark.h"
+#include "../Common/trace.h"
+#include "../Common/recorder.h"
+#include "../Common/names.h"
+
 using namespace Tellusim;
 
+/* baked takes
+ * takes are sampled with TAKES_RATE samples per second of the take time
+ * TAKES_CACHE stores baked takes next to the cameras mesh and rebakes them when the mesh changes
+ */
+#ifndef TAKES_RATE
+	#define TAKES_RATE		120.0
+#endif
+#ifndef TAKES_CACHE
+	#define TAKES_CACHE		0
+#endif
+
+/* scene update benchmark
+ * compares per-node and batched transform propagation
+ * the scene has only a few cameras, so a synthetic scene of linked nodes is measured as well
+ * BENCHMARK_SCENE_NODES is the number of root nodes with BENCHMARK_SCENE_CHILDREN linked children each
+ */
+#ifndef BENCHMARK_SCENE_UPDATE
+	#define BENCHMARK_SCENE_UPDATE		0
+#endif
+#ifndef BENCHMARK_SCENE_NODES
+	#define BENCHMARK_SCENE_NODES		1024
+#endif
+#ifndef BENCHMARK_SCENE_CHILDREN
+	#define BENCHMARK_SCENE_CHILDREN	4
+#endif
+
+/* transform recorder
+ * sun, earth, galaxy, and camera tracks are recorded into gravity.rec
+ * positions are relative to the center of the baked takes
+ * the position step keeps the farthest position within the float32 precision
+ */
+#ifndef RECORD_TRANSFORMS
+	#define RECORD_TRANSFORMS	0
+#endif
+
+/* gravity benchmark
+ * every take is played once with a fixed timestep
+ * the report is saved into gravity_benchmark.json
+ */
+#ifndef BENCHMARK_GRAVITY
+	#define BENCHMARK_GRAVITY		0
+#endif
+#ifndef BENCHMARK_STEP
+	#define BENCHMARK_STEP			(1.0 / 60.0)
+#endif
+
+/* batched scene update
+ * node transforms are propagated on commit and the graph scene is updated once
+ * the node list is reused across frames, so it is allocated once
+ */
+class SceneUpdate {
+		
+	public:
+		
+		SceneUpdate(Graph &graph, Array<Node> &nodes) : graph(graph), nodes(nodes) { }
+		~SceneUpdate() { commit(); }
+		
+		void setGlobalTransform(Node &node, const Matrix4x3d &transform) {
+			node.setGlobalTransform(transform);
+			nodes.append(node);
+		}
+		
+		void commit() {
+			if(!nodes) return;
+			for(Node &node : nodes) node.updateTransforms(true);
+			graph.updateScene();
+			nodes.clear();
+		}
+		
+	private:
+		
+		Graph &graph;
+		Array<Node> &nodes;
+};
+
 /*
  */
+Graph gravity_graph;
 Node node_sun;
 Node node_earth;
 Node node_galaxy;
@@ -36,18 +119,287 @@ Array<uint32_t> node_earth_indices;
 Array<uint32_t> node_galaxy_indices;
 Array<uint32_t> node_camera_indices;
 
-/*
+/* baked take tracks
+ * the sample translation is relative to the track origin
+ * the sample rotation is a quantized quaternion
  */
+enum {
+	TrackSun = 0,
+	TrackEarth,
+	TrackGalaxy,
+	TrackCamera,
+	NumTracks,
+};
+struct TakeSample {
+	float32_t translate[3];
+	int16_t rotate[4];
+	float32_t scale[3];
+};
 struct Take {
 	uint32_t index;
 	float64_t scale;
 	float64_t min_time;
 	float64_t max_time;
+	uint32_t num_samples;
+	uint32_t offset;
+	float64_t origins[NumTracks][3];
 };
 Array<Take> takes;
+Array<TakeSample> take_samples;
+Array<Node> scene_nodes;
+#if RECORD_TRANSFORMS
+	TransformRecorder recorder;
+	float64_t recorder_origin[3];
+#endif
 uint32_t take_index = 0;
 float64_t scene_time = 0.0;
 
+/*
+ */
+#if BENCHMARK_GRAVITY
+	enum {
+		BenchmarkFrame = 0,
+		BenchmarkAnimation,
+		BenchmarkScene,
+	};
+	BenchmarkReport benchmark_report("gravity");
+	uint64_t benchmark_begin = 0;
+	uint32_t benchmark_frame = 0;
+#endif
+
+/*
+ */
+static const uint32_t TakesMagic = ('T' | ('K' << 8) | ('S' << 16) | ('1' << 24));
+
+/* bake take sample
+ */
+static void bake_sample(const Matrix4x3d &transform, const float64_t *origin, const TakeSample *prev, TakeSample &sample) {
+	
+	// translation
+	sample.translate[0] = (float32_t)(transform.m03 - origin[0]);
+	sample.translate[1] = (float32_t)(transform.m13 - origin[1]);
+	sample.translate[2] = (float32_t)(transform.m23 - origin[2]);
+	
+	// scale
+	float64_t sx = sqrt(transform.m00 * transform.m00 + transform.m10 * transform.m10 + transform.m20 * transform.m20);
+	float64_t sy = sqrt(transform.m01 * transform.m01 + transform.m11 * transform.m11 + transform.m21 * transform.m21);
+	float64_t sz = sqrt(transform.m02 * transform.m02 + transform.m12 * transform.m12 + transform.m22 * transform.m22);
+	float64_t det = transform.m00 * (transform.m11 * transform.m22 - transform.m12 * transform.m21);
+	det -= transform.m01 * (transform.m10 * transform.m22 - transform.m12 * transform.m20);
+	det += transform.m02 * (transform.m10 * transform.m21 - transform.m11 * transform.m20);
+	if(det < 0.0) sx = -sx;
+	sample.scale[0] = (float32_t)sx;
+	sample.scale[1] = (float32_t)sy;
+	sample.scale[2] = (float32_t)sz;
+	
+	// rotation
+	float64_t m00 = transform.m00 / sx, m01 = transform.m01 / sy, m02 = transform.m02 / sz;
+	float64_t m10 = transform.m10 / sx, m11 = transform.m11 / sy, m12 = transform.m12 / sz;
+	float64_t m20 = transform.m20 / sx, m21 = transform.m21 / sy, m22 = transform.m22 / sz;
+	float64_t q[4];
+	float64_t trace = m00 + m11 + m22;
+	if(trace > 0.0) {
+		float64_t s = 0.5 / sqrt(trace + 1.0);
+		q[0] = (m21 - m12) * s; q[1] = (m02 - m20) * s; q[2] = (m10 - m01) * s; q[3] = 0.25 / s;
+	} else if(m00 > m11 && m00 > m22) {
+		float64_t s = 0.5 / sqrt(1.0 + m00 - m11 - m22);
+		q[0] = 0.25 / s; q[1] = (m01 + m10) * s; q[2] = (m02 + m20) * s; q[3] = (m21 - m12) * s;
+	} else if(m11 > m22) {
+		float64_t s = 0.5 / sqrt(1.0 + m11 - m00 - m22);
+		q[0] = (m01 + m10) * s; q[1] = 0.25 / s; q[2] = (m12 + m21) * s; q[3] = (m02 - m20) * s;
+	} else {
+		float64_t s = 0.5 / sqrt(1.0 + m22 - m00 - m11);
+		q[0] = (m02 + m20) * s; q[1] = (m12 + m21) * s; q[2] = 0.25 / s; q[3] = (m10 - m01) * s;
+	}
+	
+	// keep quaternions in the same hemisphere for interpolation
+	float64_t ilength = 1.0 / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if(prev && q[0] * prev->rotate[0] + q[1] * prev->rotate[1] + q[2] * prev->rotate[2] + q[3] * prev->rotate[3] < 0.0) ilength = -ilength;
+	for(uint32_t i = 0; i < 4; i++) sample.rotate[i] = (int16_t)clamp(floor(q[i] * ilength * 32767.0 + 0.5), -32767.0, 32767.0);
+}
+
+/* baked take transform
+ * samples are linearly interpolated with normalized quaternion blending
+ */
+static Matrix4x3d get_take_transform(const Take &take, uint32_t track, float64_t time) {
+	
+	// sample indices
+	float64_t position = clamp(time * TAKES_RATE, 0.0, (float64_t)(take.num_samples - 1));
+	uint32_t index = min((uint32_t)position, take.num_samples - 2);
+	float32_t k = (float32_t)(position - index);
+	const TakeSample &s0 = take_samples[take.offset + NumTracks * index + track];
+	const TakeSample &s1 = take_samples[take.offset + NumTracks * (index + 1) + track];
+	
+	// interpolate sample
+	float32_t q[4], length = 0.0f;
+	for(uint32_t i = 0; i < 4; i++) {
+		q[i] = s0.rotate[i] + (s1.rotate[i] - s0.rotate[i]) * k;
+		length += q[i] * q[i];
+	}
+	float32_t ilength = 1.0f / sqrtf(length);
+	float32_t x = q[0] * ilength, y = q[1] * ilength, z = q[2] * ilength, w = q[3] * ilength;
+	float32_t sx = s0.scale[0] + (s1.scale[0] - s0.scale[0]) * k;
+	float32_t sy = s0.scale[1] + (s1.scale[1] - s0.scale[1]) * k;
+	float32_t sz = s0.scale[2] + (s1.scale[2] - s0.scale[2]) * k;
+	
+	// compose transform
+	Matrix4x3d transform;
+	transform.m00 = (1.0f - 2.0f * (y * y + z * z)) * sx; transform.m01 = 2.0f * (x * y - z * w) * sy; transform.m02 = 2.0f * (x * z + y * w) * sz;
+	transform.m10 = 2.0f * (x * y + z * w) * sx; transform.m11 = (1.0f - 2.0f * (x * x + z * z)) * sy; transform.m12 = 2.0f * (y * z - x * w) * sz;
+	transform.m20 = 2.0f * (x * z - y * w) * sx; transform.m21 = 2.0f * (y * z + x * w) * sy; transform.m22 = (1.0f - 2.0f * (x * x + y * y)) * sz;
+	transform.m03 = take.origins[track][0] + (s0.translate[0] + (s1.translate[0] - s0.translate[0]) * k);
+	transform.m13 = take.origins[track][1] + (s0.translate[1] + (s1.translate[1] - s0.translate[1]) * k);
+	transform.m23 = take.origins[track][2] + (s0.translate[2] + (s1.translate[2] - s0.translate[2]) * k);
+	
+	return transform;
+}
+
+/* bake takes
+ */
+static void bake_takes() {
+	
+	MeshAnimation animation = cameras_mesh.getAnimation(0);
+	
+	take_samples.clear();
+	for(Take &take : takes) {
+		
+		// take samples
+		take.num_samples = (uint32_t)ceil((take.max_time - take.min_time) * TAKES_RATE) + 1;
+		take.offset = take_samples.size();
+		take_samples.resize(take.offset + NumTracks * take.num_samples);
+		
+		// animation nodes
+		uint32_t indices[NumTracks] = {
+			node_sun_indices[take.index],
+			node_earth_indices[take.index],
+			node_galaxy_indices[take.index],
+			node_camera_indices[take.index],
+		};
+		
+		// track origins
+		animation.setTime(take.min_time * take.scale, false);
+		for(uint32_t i = 0; i < NumTracks; i++) {
+			Matrix4x3d transform = animation.getGlobalTransform(indices[i]);
+			take.origins[i][0] = transform.m03;
+			take.origins[i][1] = transform.m13;
+			take.origins[i][2] = transform.m23;
+		}
+		
+		// sample animation
+		for(uint32_t i = 0; i < take.num_samples; i++) {
+			animation.setTime(min(take.min_time + i / TAKES_RATE, take.max_time) * take.scale, false);
+			TakeSample *samples = take_samples.get() + take.offset + NumTracks * i;
+			for(uint32_t j = 0; j < NumTracks; j++) {
+				bake_sample(animation.getGlobalTransform(indices[j]), take.origins[j], (i) ? samples - NumTracks + j : nullptr, samples[j]);
+			}
+		}
+	}
+}
+
+/* recorder origin and step
+ * the origin is the center of the track positions over all takes
+ */
+#if RECORD_TRANSFORMS
+	static float32_t get_recorder_origin(float64_t *origin) {
+		float64_t min_position[3] = { Maxf64, Maxf64, Maxf64 };
+		float64_t max_position[3] = { -Maxf64, -Maxf64, -Maxf64 };
+		for(const Take &take : takes) {
+			for(uint32_t i = 0; i < take.num_samples; i++) {
+				const TakeSample *samples = take_samples.get() + take.offset + NumTracks * i;
+				for(uint32_t j = 0; j < NumTracks; j++) {
+					for(uint32_t k = 0; k < 3; k++) {
+						float64_t position = take.origins[j][k] + samples[j].translate[k];
+						min_position[k] = min(min_position[k], position);
+						max_position[k] = max(max_position[k], position);
+					}
+				}
+			}
+		}
+		float64_t extent = 0.0;
+		for(uint32_t k = 0; k < 3; k++) {
+			origin[k] = (min_position[k] + max_position[k]) * 0.5;
+			extent = max(extent, (max_position[k] - min_position[k]) * 0.5);
+		}
+		if(extent <= 0.0) return 1.0f / 1024.0f;
+		return (float32_t)ldexp(1.0, (int32_t)ceil(log2(extent / (1 << 24))));
+	}
+#endif
+
+/* source file hash
+ * FNV-1a of the file content
+ */
+static uint64_t get_file_hash(const char *name) {
+	File file;
+	if(!file.open(name, "rb")) return 0;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	Array<uint8_t> data(64 * 1024);
+	while(size_t size = file.read(data.get(), data.size())) {
+		for(size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/* baked takes cache
+ * flat layout with the take table and the sample array
+ * the header contains the sample rate and the hash of the source mesh file
+ */
+static bool load_takes(const char *name, uint64_t mesh_hash) {
+	
+	File file;
+	if(!File::isFile(name) || !file.open(name, "rb")) return false;
+	
+	// check header
+	float64_t rate = 0.0;
+	uint64_t hash = 0;
+	if(file.readu32() != TakesMagic || file.readu32() != takes.size()) return false;
+	if(file.read(&rate, sizeof(rate)) != sizeof(rate) || rate != TAKES_RATE) return false;
+	if(file.read(&hash, sizeof(hash)) != sizeof(hash) || hash != mesh_hash) {
+		TS_LOGF(Warning, "load_takes(): %s is out of date\n", name);
+		return false;
+	}
+	
+	// check take table
+	Array<Take> cached_takes(takes.size());
+	if(file.read(cached_takes.get(), cached_takes.bytes()) != cached_takes.bytes()) return false;
+	uint32_t num_take_samples = 0;
+	for(uint32_t i = 0; i < takes.size(); i++) {
+		const Take &take = cached_takes[i];
+		if(take.index != takes[i].index || take.scale != takes[i].scale) return false;
+		if(take.min_time != takes[i].min_time || take.max_time != takes[i].max_time) return false;
+		if(take.offset != num_take_samples) return false;
+		num_take_samples += NumTracks * take.num_samples;
+	}
+	
+	// read samples
+	uint32_t num_samples = file.readu32();
+	if(num_samples != num_take_samples) return false;
+	take_samples.resize(num_samples);
+	if(file.read(take_samples.get(), take_samples.bytes()) != take_samples.bytes()) {
+		take_samples.clear();
+		return false;
+	}
+	takes = cached_takes;
+	
+	return true;
+}
+
+static bool save_takes(const char *name, uint64_t mesh_hash) {
+	
+	File file;
+	if(!file.open(name, "wb")) return false;
+	
+	float64_t rate = TAKES_RATE;
+	file.writeu32(TakesMagic);
+	file.writeu32(takes.size());
+	if(file.write(&rate, sizeof(rate)) != sizeof(rate)) return false;
+	if(file.write(&mesh_hash, sizeof(mesh_hash)) != sizeof(mesh_hash)) return false;
+	if(file.write(takes.get(), takes.bytes()) != takes.bytes()) return false;
+	file.writeu32(take_samples.size());
+	if(file.write(take_samples.get(), take_samples.bytes()) != take_samples.bytes()) return false;
+	
+	return true;
+}
+
 /*
  */
 EXPORT(create) {
@@ -57,12 +409,19 @@ EXPORT(create) {
 	Scene &scene = self->scene;
 	
 	// graph graph
-	Graph gravity_graph = scene.getGraph("Gravity");
+	gravity_graph = scene.getGraph("Gravity");
 	if(!gravity_graph) {
 		TS_LOG(Error, "Gravity::create(): can't get graph\n");
 		return false;
 	}
 	
+	// benchmark stages
+	#if BENCHMARK_GRAVITY
+		benchmark_report.addStage("frame");
+		benchmark_report.addStage("animation");
+		benchmark_report.addStage("scene");
+	#endif
+	
 	// get nodes
 	node_sun = gravity_graph.getNode("Sun");
 	node_earth = gravity_graph.getNode("Earth");
@@ -73,11 +432,10 @@ EXPORT(create) {
 	}
 	
 	// get scene cameras
-	for(uint32_t i = 0; i < Maxu16; i++) {
-		String name = String::format("Camera_%u", i);
-		uint32_t index = gravity_graph.findNode(name.get());
-		if(index != Maxu32) node_cameras.append(NodeCamera(gravity_graph.getNode(index)));
-		else break;
+	Array<uint32_t> indices;
+	findIndexedNames(gravity_graph.getNumNodes(), "Camera_", [](uint32_t index) { return gravity_graph.getNode(index).getName(); }, indices);
+	for(uint32_t index : indices) {
+		node_cameras.append(NodeCamera(gravity_graph.getNode(index)));
 	}
 	if(!node_cameras) {
 		TS_LOG(Error, "Gravity::create(): can't find cameras\n");
@@ -91,19 +449,15 @@ EXPORT(create) {
 	}
 	
 	// animation indices
-	for(uint32_t i = 0; i < node_cameras.size(); i++) {
-		uint32_t sun_index = cameras_mesh.findNode(String::format("Sun_%u", i).get());
-		uint32_t earth_index = cameras_mesh.findNode(String::format("Earth_%u", i).get());
-		uint32_t galaxy_index = cameras_mesh.findNode(String::format("Galaxy_%u", i).get());
-		uint32_t camera_index = cameras_mesh.findNode(String::format("Camera_%u", i).get());
-		if(sun_index == Maxu32 || earth_index == Maxu32 || galaxy_index == Maxu32 || camera_index == Maxu32) {
-			TS_LOG(Error, "Gravity::create(): can't find nodes\n");
-			return false;
-		}
-		node_sun_indices.append(sun_index);
-		node_earth_indices.append(earth_index);
-		node_galaxy_indices.append(galaxy_index);
-		node_camera_indices.append(camera_index);
+	auto get_mesh_name = [](uint32_t index) { return cameras_mesh.getNode(index).getName(); };
+	uint32_t num_mesh_nodes = cameras_mesh.getNumNodes();
+	findIndexedNames(num_mesh_nodes, "Sun_", get_mesh_name, node_sun_indices);
+	findIndexedNames(num_mesh_nodes, "Earth_", get_mesh_name, node_earth_indices);
+	findIndexedNames(num_mesh_nodes, "Galaxy_", get_mesh_name, node_galaxy_indices);
+	findIndexedNames(num_mesh_nodes, "Camera_", get_mesh_name, node_camera_indices);
+	if(node_sun_indices.size() < node_cameras.size() || node_earth_indices.size() < node_cameras.size() || node_galaxy_indices.size() < node_cameras.size() || node_camera_indices.size() < node_cameras.size()) {
+		TS_LOG(Error, "Gravity::create(): can't find nodes\n");
+		return false;
 	}
 	
 	// camera takes
@@ -117,6 +471,104 @@ EXPORT(create) {
 		{ 1, 0.4, 2.0, 30.0 },
 	};
 	
+	// bake camera takes
+	uint64_t begin = Time::current();
+	#if TAKES_CACHE
+		uint64_t mesh_hash = get_file_hash("meshes/cameras.mesh");
+		if(!load_takes("meshes/cameras.takes", mesh_hash)) {
+			bake_takes();
+			if(!save_takes("meshes/cameras.takes", mesh_hash)) TS_LOG(Warning, "Gravity::create(): can't save takes\n");
+		}
+	#else
+		bake_takes();
+	#endif
+	TS_LOGF(Message, "Gravity::create(): %u take samples %u KB %s\n", take_samples.size(), (uint32_t)(take_samples.bytes() / 1024), String::fromTime(Time::current() - begin).get());
+	
+	// transform stream
+	#if RECORD_TRANSFORMS
+		float32_t recorder_step = get_recorder_origin(recorder_origin);
+		if(!recorder.open("gravity.rec", NumTracks, recorder_step, 256, recorder_origin)) TS_LOG(Error, "Gravity::create(): can't create recorder\n");
+		else TS_LOGF(Message, "Gravity::create(): recording with %g position step\n", recorder_step);
+	#endif
+	
+	// scene update benchmark
+	#if BENCHMARK_SCENE_UPDATE
+		const uint32_t num_frames = 256;
+		Matrix4x3d transforms[NumTracks];
+		for(uint32_t i = 0; i < NumTracks; i++) transforms[i] = get_take_transform(takes[0], i, 0.0);
+		
+		// per-node updates
+		begin = Time::current();
+		for(uint32_t i = 0; i < num_frames; i++) {
+			node_sun.setGlobalTransform(transforms[TrackSun]);
+			node_sun.updateScene();
+			node_earth.setGlobalTransform(transforms[TrackEarth]);
+			node_earth.updateTransforms(true);
+			node_galaxy.setGlobalTransform(transforms[TrackGalaxy]);
+			node_galaxy.updateTransforms(true);
+			for(NodeCamera &node_camera : node_cameras) {
+				node_camera.setGlobalTransform(transforms[TrackCamera]);
+				node_camera.updateTransforms(true);
+				node_camera.updateScene();
+			}
+		}
+		uint64_t nodes_time = Time::current() - begin;
+		
+		// batched updates
+		begin = Time::current();
+		for(uint32_t i = 0; i < num_frames; i++) {
+			SceneUpdate scene_update(gravity_graph, scene_nodes);
+			scene_update.setGlobalTransform(node_sun, transforms[TrackSun]);
+			scene_update.setGlobalTransform(node_earth, transforms[TrackEarth]);
+			scene_update.setGlobalTransform(node_galaxy, transforms[TrackGalaxy]);
+			for(NodeCamera &node_camera : node_cameras) {
+				scene_update.setGlobalTransform(node_camera, transforms[TrackCamera]);
+			}
+		}
+		uint64_t batch_time = Time::current() - begin;
+		
+		TS_LOGF(Message, "Gravity::create(): %u cameras: nodes %s batch %s per frame\n", node_cameras.size(), String::fromTime(nodes_time / num_frames).get(), String::fromTime(batch_time / num_frames).get());
+		
+		// synthetic scene
+		// the linked children are propagated by the root transform updates
+		// the internal nodes stay in the graph and are never transformed again
+		Array<Node> root_nodes;
+		root_nodes.reserve(BENCHMARK_SCENE_NODES);
+		for(uint32_t i = 0; i < BENCHMARK_SCENE_NODES; i++) {
+			NodeDummy root_node = NodeDummy(gravity_graph);
+			root_node.setInternal(true);
+			for(uint32_t j = 0; j < BENCHMARK_SCENE_CHILDREN; j++) {
+				NodeDummy child_node = NodeDummy(gravity_graph);
+				child_node.setParent(root_node);
+				child_node.setInternal(true);
+			}
+			root_nodes.append(root_node);
+		}
+		
+		// per-node updates
+		begin = Time::current();
+		for(uint32_t i = 0; i < num_frames; i++) {
+			for(Node &node : root_nodes) {
+				node.setGlobalTransform(transforms[TrackCamera]);
+				node.updateTransforms(true);
+				node.updateScene();
+			}
+		}
+		nodes_time = Time::current() - begin;
+		
+		// batched updates
+		begin = Time::current();
+		for(uint32_t i = 0; i < num_frames; i++) {
+			SceneUpdate scene_update(gravity_graph, scene_nodes);
+			for(Node &node : root_nodes) {
+				scene_update.setGlobalTransform(node, transforms[TrackCamera]);
+			}
+		}
+		batch_time = Time::current() - begin;
+		
+		TS_LOGF(Message, "Gravity::create(): %u nodes %u children: nodes %s batch %s per frame\n", root_nodes.size(), root_nodes.size() * BENCHMARK_SCENE_CHILDREN, String::fromTime(nodes_time / num_frames).get(), String::fromTime(batch_time / num_frames).get());
+	#endif
+	
 	return true;
 }
 
@@ -127,11 +579,23 @@ EXPORT(release) {
 	TS_LOG(Message, "Gravity::release(): is called\n");
 	
 	// clear cameras
+	gravity_graph.clearPtr();
 	node_cameras.release();
 	node_sun_indices.release();
 	node_earth_indices.release();
 	node_galaxy_indices.release();
 	node_camera_indices.release();
+	take_samples.release();
+	scene_nodes.release();
+	
+	// close transform stream
+	#if RECORD_TRANSFORMS
+		recorder.close();
+		if(recorder.getRawBytes()) TS_LOGF(Message, "Gravity::release(): recorded %.1f MB/s ratio %.1f\n", recorder.getThroughput(), recorder.getRatio());
+	#endif
+	
+	// save trace
+	if(Trace::isEnabled() && !Trace::save("gravity_trace.json")) TS_LOG(Error, "Gravity::release(): can't save trace\n");
 	
 	return true;
 }
@@ -140,44 +604,86 @@ EXPORT(release) {
  */
 EXPORT(update) {
 	
+	TRACE_ZONE("Gravity::update");
+	
 	Scene &scene = self->scene;
 	Window &window = self->window;
 	
+	// fixed timestep clock
+	// the scene time is driven by the benchmark for graph scripts
+	#if BENCHMARK_GRAVITY
+		uint64_t frame_begin = Time::current();
+		if(benchmark_begin) benchmark_report.append(BenchmarkFrame, frame_begin - benchmark_begin);
+		benchmark_begin = frame_begin;
+		float64_t current_time = benchmark_frame++ * BENCHMARK_STEP;
+		scene.setTime(current_time);
+		bool next_take = false;
+	#else
+		float64_t current_time = scene.getTime();
+		bool next_take = window.getKeyboardKey(Window::KeyReturn, true);
+	#endif
+	
 	// update take
-	float64_t take_time = scene.getTime() - scene_time;
-	if(take_time > takes[take_index].max_time - takes[take_index].min_time || window.getKeyboardKey(Window::KeyReturn, true)) {
+	float64_t take_time = current_time - scene_time;
+	if(take_time > takes[take_index].max_time - takes[take_index].min_time || next_take) {
+		#if BENCHMARK_GRAVITY
+			if(take_index + 1 == takes.size()) {
+				if(!benchmark_report.save("gravity_benchmark.json")) TS_LOG(Error, "Gravity::update(): can't save benchmark\n");
+				TS_LOGF(Message, "Gravity::update(): %u frames\n%s", benchmark_frame, benchmark_report.getJSON().get());
+				return false;
+			}
+		#endif
 		if(take_index + 1 < takes.size()) take_index++;
 		else take_index = 0;
-		scene_time = scene.getTime();
+		scene_time = current_time;
 		take_time = 0.0;
 	}
 	
-	// update animation time
+	// baked take time
 	const Take &take = takes[take_index];
-	MeshAnimation animation = cameras_mesh.getAnimation(0);
-	animation.setTime(min(take_time + take.min_time, take.max_time) * take.scale, false);
+	float64_t time = min(take_time, take.max_time - take.min_time);
+	
+	// sample take transforms
+	uint64_t begin = Time::current();
+	Matrix4x3d transforms[NumTracks];
+	for(uint32_t i = 0; i < NumTracks; i++) {
+		transforms[i] = get_take_transform(take, i, time);
+	}
+	#if BENCHMARK_GRAVITY
+		benchmark_report.append(BenchmarkAnimation, Time::current() - begin);
+	#endif
 	
-	// update sun transform
-	node_sun.setGlobalTransform(animation.getGlobalTransform(node_sun_indices[take.index]));
-	node_sun.updateScene();
+	// record track transforms
+	#if RECORD_TRANSFORMS
+		float32_t rows[NumTracks * 12];
+		for(uint32_t i = 0; i < NumTracks; i++) {
+			TransformStream::get_rows(transforms[i], recorder_origin, rows + i * 12);
+		}
+		recorder.record(current_time, rows);
+	#endif
 	
-	// update earth transform
-	node_earth.setGlobalTransform(animation.getGlobalTransform(node_earth_indices[take.index]));
-	node_earth.updateTransforms(true);
+	// node transforms are propagated once per frame
+	SceneUpdate scene_update(gravity_graph, scene_nodes);
 	
-	// update galaxy transform
-	node_galaxy.setGlobalTransform(animation.getGlobalTransform(node_galaxy_indices[take.index]));
-	node_galaxy.updateTransforms(true);
+	// update sun, earth, and galaxy transforms
+	scene_update.setGlobalTransform(node_sun, transforms[TrackSun]);
+	scene_update.setGlobalTransform(node_earth, transforms[TrackEarth]);
+	scene_update.setGlobalTransform(node_galaxy, transforms[TrackGalaxy]);
 	
 	// update camera transform and exposure
-	Matrix4x3d transform = animation.getGlobalTransform(node_camera_indices[take.index]);
 	float32_t fade = (float32_t)max(1.0 - take_time * 2.0, 1.0 - (take.max_time - take.min_time - take_time) * 2.0, 0.0);
 	for(NodeCamera &node_camera : node_cameras) {
 		node_camera.getCamera().setExposureScale(-fade * 20.0f);
-		node_camera.setGlobalTransform(transform);
-		node_camera.updateTransforms(true);
-		node_camera.updateScene();
+		scene_update.setGlobalTransform(node_camera, transforms[TrackCamera]);
 	}
 	
+	// propagate transforms
+	TRACE_ZONE("Gravity::commit");
+	begin = Time::current();
+	scene_update.commit();
+	#if BENCHMARK_GRAVITY
+		benchmark_report.append(BenchmarkScene, Time::current() - begin);
+	#endif
+	
 	return true;
 }
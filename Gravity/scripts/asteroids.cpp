@@ -21,19 +21,458 @@
 // SOFTWARE.
 
 #include <core/TellusimLog.h>
+#include <core/TellusimTime.h>
+#include <core/TellusimFile.h>
 #include <math/TellusimRandom.h>
 #include <platform/TellusimBuffer.h>
 #include <platform/TellusimKernel.h>
 #include <platform/TellusimCompute.h>
 #include <platform/TellusimDevice.h>
+#include <platform/TellusimShader.h>
 #include <scene/TellusimScenes.h>
 #include <scene/TellusimObject.h>
 #include <scene/TellusimNodes.h>
 
+#include <thread>
+#include <stdlib.h>
+#include <float.h>
+
+#include "../../Common/benchmark.h"
+#include "../../Common/trace.h"
+#include "../../Common/names.h"
+#include "../../Common/recorder.h"
+#include "../../Common/workers.h"
+
+#if __AVX2__
+	#include <immintrin.h>
+#elif __SSE2__
+	#include <emmintrin.h>
+#elif __ARM_NEON && __aarch64__
+	#include <arm_neon.h>
+#endif
+
 using namespace Tellusim;
 
 layout(instance = GraphAsteroids);
 
+/* number of asteroids
+ * the NUM_ASTEROIDS environment variable overrides the default count
+ */
+#ifndef NUM_ASTEROIDS
+	#define NUM_ASTEROIDS	200000
+#endif
+
+static uint32_t get_num_asteroids() {
+	const char *value = getenv("NUM_ASTEROIDS");
+	int32_t num = (value) ? atoi(value) : 0;
+	return (num > 0) ? (uint32_t)num : NUM_ASTEROIDS;
+}
+
+/* CPU transform
+ * node transforms are computed on the CPU even if compute shaders are available
+ * VALIDATE_TRANSFORM compares the CPU transforms with the float64 reference on create
+ */
+#ifndef CPU_TRANSFORM
+	#define CPU_TRANSFORM		0
+#endif
+#ifndef VALIDATE_TRANSFORM
+	#define VALIDATE_TRANSFORM	0
+#endif
+
+/* transform benchmark
+ * per-asteroid cost of per-frame orbit parameters versus the orbits table on CPU and GPU
+ */
+#ifndef BENCHMARK_TRANSFORM
+	#define BENCHMARK_TRANSFORM	0
+#endif
+
+/* asteroids sweep
+ * asteroid counts are measured in turn and saved into asteroids_sweep.csv
+ * culling is disabled, so every asteroid is transformed on every frame
+ */
+#ifndef ASTEROIDS_SWEEP
+	#define ASTEROIDS_SWEEP		0
+#endif
+
+/* gravity benchmark
+ * per-frame asteroid stages are saved into asteroids_benchmark.json
+ */
+#ifndef BENCHMARK_GRAVITY
+	#define BENCHMARK_GRAVITY	0
+#endif
+
+/* transform recorder
+ * CPU transforms are recorded into asteroids.rec, so recording forces the CPU path
+ * replay sets node transforms from asteroids.rec without the transform pass
+ */
+#ifndef RECORD_TRANSFORMS
+	#define RECORD_TRANSFORMS	0
+#endif
+#ifndef REPLAY_TRANSFORMS
+	#define REPLAY_TRANSFORMS	0
+#endif
+
+/* asteroids culling
+ * the camera cone encloses the camera field of view at the widest expected viewport aspect
+ * the compute path builds the visible list on the CPU and uploads it every frame
+ * so it is culled only with KERNEL_CULLING until that is measured to be faster
+ * CULLING_ANGLE is the half-angle in degrees for cameras without a field of view
+ */
+#ifndef ASTEROIDS_CULLING
+	#define ASTEROIDS_CULLING	1
+#endif
+#ifndef KERNEL_CULLING
+	#define KERNEL_CULLING		0
+#endif
+#ifndef CULLING_ASPECT
+	#define CULLING_ASPECT		(21.0f / 9.0f)
+#endif
+#ifndef CULLING_ANGLE
+	#define CULLING_ANGLE		60.0f
+#endif
+
+/* asteroid orbit parameters
+ * CPU version of the shaders/transform.shader math
+ */
+struct AsteroidOrbit {
+	float32_t offset_sin;
+	float32_t offset_cos;
+	float32_t angle_speed;
+	float32_t translate_x;
+	float32_t translate_y;
+	float32_t translate_z;
+	float32_t scale;
+	float32_t rotate_x;
+	float32_t rotate_y;
+	float32_t rotate_z;
+	float32_t rotate_speed_x;
+	float32_t rotate_speed_y;
+	float32_t rotate_speed_z;
+};
+
+/*
+ */
+static float32_t asteroid_halton2(uint32_t i) {
+	uint32_t bits = (i << 16u) | (i >> 16u);
+	bits = ((bits & 0x00ff00ffu) << 8u) | ((bits & 0xff00ff00u) >> 8u);
+	bits = ((bits & 0x0f0f0f0fu) << 4u) | ((bits & 0xf0f0f0f0u) >> 4u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xccccccccu) >> 2u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xaaaaaaaau) >> 1u);
+	return (float32_t)bits * 2.3283064365386963e-10f;
+}
+
+static float32_t asteroid_fract(float32_t x) {
+	return x - floorf(x);
+}
+
+static void get_asteroid_orbit(uint32_t id, AsteroidOrbit &orbit) {
+	
+	float32_t k = asteroid_halton2(id);
+	
+	float32_t noise_0 = asteroid_fract(sinf((float32_t)id * 17.31713f) * 13731.13731f);
+	float32_t noise_1 = asteroid_fract(sinf((float32_t)id * 13.71317f) * 17371.17371f);
+	float32_t noise_2 = asteroid_fract(sinf((float32_t)id * 37.13717f) * 37137.37137f);
+	float32_t noise = (noise_0 + noise_1 + noise_2) / 3.0f;
+	
+	float32_t range = 2001.0f * k + cosf(noise * 113.0f) * 173.0f;
+	float32_t offset = 1337.0f * k + noise * 173.0f;
+	orbit.offset_sin = sinf(offset);
+	orbit.offset_cos = cosf(offset);
+	orbit.angle_speed = (noise + 1.4f - k) * 0.011f;
+	
+	orbit.translate_x = 2000.0f + range;
+	orbit.translate_y = sinf(noise_0 * 31.7f) * noise * 213.0f;
+	orbit.translate_z = sinf(noise * 13.7f) * 217.0f * (noise_0 * noise_2 + (k - 0.5f) * 0.1f);
+	orbit.scale = 1.3f + sinf(noise * 117.3f) * 0.4f;
+	
+	orbit.rotate_x = k * 31.31f;
+	orbit.rotate_y = k * 13.13f;
+	orbit.rotate_z = k * 37.37f;
+	orbit.rotate_speed_x = sinf(noise_0 * 31.7f) * 0.31f;
+	orbit.rotate_speed_y = sinf(noise_1 * 13.7f) * 0.27f;
+	orbit.rotate_speed_z = sinf(noise_2 * 37.1f) * 0.33f;
+}
+
+/* scalar reference transform
+ * follows the shader step by step in double precision, the result is a row-major 3x4 matrix
+ * returns the largest angle argument, which bounds the float32 rounding of the fast path
+ */
+static float64_t get_asteroid_transform(uint32_t id, float32_t time, float64_t *transform) {
+	
+	AsteroidOrbit orbit;
+	get_asteroid_orbit(id, orbit);
+	
+	// quat_rotate_zyx()
+	float64_t argument_x = orbit.rotate_x + (float64_t)orbit.rotate_speed_x * time;
+	float64_t argument_y = orbit.rotate_y + (float64_t)orbit.rotate_speed_y * time;
+	float64_t argument_z = orbit.rotate_z + (float64_t)orbit.rotate_speed_z * time;
+	float64_t sx = sin(argument_x * 0.5), cx = cos(argument_x * 0.5);
+	float64_t sy = sin(argument_y * 0.5), cy = cos(argument_y * 0.5);
+	float64_t sz = sin(argument_z * 0.5), cz = cos(argument_z * 0.5);
+	float64_t x = sx * cy * cz - cx * sy * sz;
+	float64_t y = cx * sy * cz + sx * cy * sz;
+	float64_t z = cx * cy * sz - sx * sy * cz;
+	float64_t w = cx * cy * cz + sx * sy * sz;
+	
+	// mat4x3_compose()
+	float64_t s = orbit.scale;
+	float64_t m[12] = {
+		(1.0 - 2.0 * (y * y + z * z)) * s, 2.0 * (x * y - z * w) * s, 2.0 * (x * z + y * w) * s, orbit.translate_x,
+		2.0 * (x * y + z * w) * s, (1.0 - 2.0 * (x * x + z * z)) * s, 2.0 * (y * z - x * w) * s, orbit.translate_y,
+		2.0 * (x * z - y * w) * s, 2.0 * (y * z + x * w) * s, (1.0 - 2.0 * (x * x + y * y)) * s, orbit.translate_z,
+	};
+	
+	// mat4x3_rotate_z(angle) * transform
+	float64_t angle = (float64_t)time * orbit.angle_speed;
+	float64_t sa = sin(angle), ca = cos(angle);
+	for(uint32_t i = 0; i < 4; i++) {
+		float64_t m0 = m[i + 0], m1 = m[i + 4];
+		m[i + 0] = ca * m0 - sa * m1;
+		m[i + 4] = sa * m0 + ca * m1;
+	}
+	
+	// mat4x3_rotate_z(offset) * transform
+	float64_t so = orbit.offset_sin, co = orbit.offset_cos;
+	for(uint32_t i = 0; i < 4; i++) {
+		transform[i + 0] = co * m[i + 0] - so * m[i + 4];
+		transform[i + 4] = so * m[i + 0] + co * m[i + 4];
+		transform[i + 8] = m[i + 8];
+	}
+	
+	return max(max(fabs(argument_x), fabs(argument_y)), max(fabs(argument_z), fabs(angle)));
+}
+
+/* SIMD lanes
+ */
+#if __AVX2__
+	
+	#define SIMD_WIDTH	8
+	
+	struct SimdFloat {
+		SimdFloat() { }
+		SimdFloat(__m256 v) : vec(v) { }
+		explicit SimdFloat(float32_t v) : vec(_mm256_set1_ps(v)) { }
+		static SimdFloat load(const float32_t *src) { return _mm256_loadu_ps(src); }
+		void store(float32_t *dest) const { _mm256_storeu_ps(dest, vec); }
+		__m256 vec;
+	};
+	
+	TS_INLINE SimdFloat operator+(const SimdFloat &v0, const SimdFloat &v1) { return _mm256_add_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat operator-(const SimdFloat &v0, const SimdFloat &v1) { return _mm256_sub_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat operator*(const SimdFloat &v0, const SimdFloat &v1) { return _mm256_mul_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_min(const SimdFloat &v0, const SimdFloat &v1) { return _mm256_min_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_max(const SimdFloat &v0, const SimdFloat &v1) { return _mm256_max_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_round(const SimdFloat &v) { return _mm256_round_ps(v.vec, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	
+#elif __SSE2__
+	
+	#define SIMD_WIDTH	4
+	
+	struct SimdFloat {
+		SimdFloat() { }
+		SimdFloat(__m128 v) : vec(v) { }
+		explicit SimdFloat(float32_t v) : vec(_mm_set1_ps(v)) { }
+		static SimdFloat load(const float32_t *src) { return _mm_loadu_ps(src); }
+		void store(float32_t *dest) const { _mm_storeu_ps(dest, vec); }
+		__m128 vec;
+	};
+	
+	TS_INLINE SimdFloat operator+(const SimdFloat &v0, const SimdFloat &v1) { return _mm_add_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat operator-(const SimdFloat &v0, const SimdFloat &v1) { return _mm_sub_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat operator*(const SimdFloat &v0, const SimdFloat &v1) { return _mm_mul_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_min(const SimdFloat &v0, const SimdFloat &v1) { return _mm_min_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_max(const SimdFloat &v0, const SimdFloat &v1) { return _mm_max_ps(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_round(const SimdFloat &v) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(v.vec)); }
+	
+#elif __ARM_NEON && __aarch64__
+	
+	#define SIMD_WIDTH	4
+	
+	struct SimdFloat {
+		SimdFloat() { }
+		SimdFloat(float32x4_t v) : vec(v) { }
+		explicit SimdFloat(float32_t v) : vec(vdupq_n_f32(v)) { }
+		static SimdFloat load(const float32_t *src) { return vld1q_f32(src); }
+		void store(float32_t *dest) const { vst1q_f32(dest, vec); }
+		float32x4_t vec;
+	};
+	
+	TS_INLINE SimdFloat operator+(const SimdFloat &v0, const SimdFloat &v1) { return vaddq_f32(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat operator-(const SimdFloat &v0, const SimdFloat &v1) { return vsubq_f32(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat operator*(const SimdFloat &v0, const SimdFloat &v1) { return vmulq_f32(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_min(const SimdFloat &v0, const SimdFloat &v1) { return vminq_f32(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_max(const SimdFloat &v0, const SimdFloat &v1) { return vmaxq_f32(v0.vec, v1.vec); }
+	TS_INLINE SimdFloat simd_round(const SimdFloat &v) { return vrndnq_f32(v.vec); }
+	
+#else
+	
+	#define SIMD_WIDTH	1
+	
+	struct SimdFloat {
+		SimdFloat() { }
+		explicit SimdFloat(float32_t v) : vec(v) { }
+		static SimdFloat load(const float32_t *src) { return SimdFloat(*src); }
+		void store(float32_t *dest) const { *dest = vec; }
+		float32_t vec;
+	};
+	
+	TS_INLINE SimdFloat operator+(const SimdFloat &v0, const SimdFloat &v1) { return SimdFloat(v0.vec + v1.vec); }
+	TS_INLINE SimdFloat operator-(const SimdFloat &v0, const SimdFloat &v1) { return SimdFloat(v0.vec - v1.vec); }
+	TS_INLINE SimdFloat operator*(const SimdFloat &v0, const SimdFloat &v1) { return SimdFloat(v0.vec * v1.vec); }
+	TS_INLINE SimdFloat simd_min(const SimdFloat &v0, const SimdFloat &v1) { return SimdFloat(v0.vec < v1.vec ? v0.vec : v1.vec); }
+	TS_INLINE SimdFloat simd_max(const SimdFloat &v0, const SimdFloat &v1) { return SimdFloat(v0.vec > v1.vec ? v0.vec : v1.vec); }
+	TS_INLINE SimdFloat simd_round(const SimdFloat &v) { return SimdFloat(floorf(v.vec + 0.5f)); }
+	
+#endif
+
+/* sine and cosine
+ * two-step 2*Pi reduction and odd polynomial on the [-Pi/2, Pi/2] range
+ */
+TS_INLINE SimdFloat simd_sin_poly(const SimdFloat &x) {
+	SimdFloat x2 = x * x;
+	SimdFloat p = SimdFloat(-2.5052108e-8f) * x2 + SimdFloat(2.7557319e-6f);
+	p = p * x2 - SimdFloat(1.9841270e-4f);
+	p = p * x2 + SimdFloat(8.3333333e-3f);
+	p = p * x2 - SimdFloat(1.6666667e-1f);
+	return x + x * x2 * p;
+}
+
+TS_INLINE void simd_sincos(SimdFloat x, SimdFloat &s, SimdFloat &c) {
+	SimdFloat n = simd_round(x * SimdFloat(0.15915494309f));
+	x = x - n * SimdFloat(6.28125f);
+	x = x - n * SimdFloat(1.9353071795864769e-3f);
+	SimdFloat y = simd_min(x, SimdFloat(3.14159265359f) - x);
+	y = simd_max(y, SimdFloat(-3.14159265359f) - y);
+	s = simd_sin_poly(y);
+	c = simd_sin_poly(SimdFloat(1.57079632679f) - simd_max(x, SimdFloat(0.0f) - x));
+}
+
+/* SIMD transform
+ * transforms SIMD_WIDTH asteroids from the structure-of-arrays orbit parameters
+ */
+#define ORBIT_SIZE	(sizeof(AsteroidOrbit) / sizeof(float32_t))
+
+static void get_asteroid_transforms(const float32_t *orbit, uint32_t stride, float32_t time, float32_t *transforms) {
+	
+	SimdFloat t = SimdFloat(time);
+	SimdFloat half = SimdFloat(0.5f);
+	SimdFloat two = SimdFloat(2.0f);
+	
+	// rotation quaternion
+	SimdFloat sx, cx, sy, cy, sz, cz;
+	simd_sincos((SimdFloat::load(orbit + stride * 7) + SimdFloat::load(orbit + stride * 10) * t) * half, sx, cx);
+	simd_sincos((SimdFloat::load(orbit + stride * 8) + SimdFloat::load(orbit + stride * 11) * t) * half, sy, cy);
+	simd_sincos((SimdFloat::load(orbit + stride * 9) + SimdFloat::load(orbit + stride * 12) * t) * half, sz, cz);
+	SimdFloat x = sx * cy * cz - cx * sy * sz;
+	SimdFloat y = cx * sy * cz + sx * cy * sz;
+	SimdFloat z = cx * cy * sz - sx * sy * cz;
+	SimdFloat w = cx * cy * cz + sx * sy * sz;
+	
+	// scaled rotation matrix
+	SimdFloat s = SimdFloat::load(orbit + stride * 6);
+	SimdFloat ts = two * s;
+	SimdFloat m[12];
+	m[0] = s - (y * y + z * z) * ts;
+	m[1] = (x * y - z * w) * ts;
+	m[2] = (x * z + y * w) * ts;
+	m[3] = SimdFloat::load(orbit + stride * 3);
+	m[4] = (x * y + z * w) * ts;
+	m[5] = s - (x * x + z * z) * ts;
+	m[6] = (y * z - x * w) * ts;
+	m[7] = SimdFloat::load(orbit + stride * 4);
+	m[8] = (x * z - y * w) * ts;
+	m[9] = (y * z + x * w) * ts;
+	m[10] = s - (x * x + y * y) * ts;
+	m[11] = SimdFloat::load(orbit + stride * 5);
+	
+	// both orbit rotations around the Z axis are merged
+	SimdFloat sa, ca;
+	simd_sincos(SimdFloat::load(orbit + stride * 2) * t, sa, ca);
+	SimdFloat so = SimdFloat::load(orbit);
+	SimdFloat co = SimdFloat::load(orbit + stride * 1);
+	SimdFloat sr = so * ca + co * sa;
+	SimdFloat cr = co * ca - so * sa;
+	for(uint32_t i = 0; i < 4; i++) {
+		SimdFloat m0 = m[i + 0];
+		m[i + 0] = cr * m0 - sr * m[i + 4];
+		m[i + 4] = sr * m0 + cr * m[i + 4];
+	}
+	
+	// lane-major to row-major
+	float32_t data[12][SIMD_WIDTH];
+	for(uint32_t i = 0; i < 12; i++) m[i].store(data[i]);
+	for(uint32_t i = 0; i < SIMD_WIDTH; i++) {
+		for(uint32_t j = 0; j < 12; j++) {
+			transforms[i * 12 + j] = data[j][i];
+		}
+	}
+}
+
+/* asteroids transform range
+ * begin and end are aligned to the SIMD_WIDTH
+ * orbit parameters are derived from the index when the orbits table is not specified
+ */
+static void transform_asteroids(uint32_t begin, uint32_t end, float32_t time, const float32_t *orbits, uint32_t stride, float32_t *transforms) {
+	
+	// precomputed orbits
+	if(orbits) {
+		for(uint32_t i = begin; i < end; i += SIMD_WIDTH) {
+			get_asteroid_transforms(orbits + i, stride, time, transforms + i * 12);
+		}
+	}
+	
+	// per-frame orbits
+	else {
+		AsteroidOrbit data;
+		float32_t orbit[ORBIT_SIZE * SIMD_WIDTH];
+		for(uint32_t i = begin; i < end; i += SIMD_WIDTH) {
+			for(uint32_t j = 0; j < SIMD_WIDTH; j++) {
+				get_asteroid_orbit(i + j, data);
+				const float32_t *src = (const float32_t*)&data;
+				for(uint32_t k = 0; k < ORBIT_SIZE; k++) orbit[SIMD_WIDTH * k + j] = src[k];
+			}
+			get_asteroid_transforms(orbit, SIMD_WIDTH, time, transforms + i * 12);
+		}
+	}
+}
+
+/* visible asteroids transform range
+ * orbit parameters are gathered by the asteroid indices
+ */
+static void transform_visible_asteroids(uint32_t begin, uint32_t end, float32_t time, const uint32_t *indices, const float32_t *orbits, uint32_t stride, float32_t *transforms) {
+	
+	float32_t orbit[ORBIT_SIZE * SIMD_WIDTH];
+	for(uint32_t i = begin; i < end; i += SIMD_WIDTH) {
+		for(uint32_t j = 0; j < SIMD_WIDTH; j++) {
+			uint32_t index = indices[i + j];
+			for(uint32_t k = 0; k < ORBIT_SIZE; k++) orbit[SIMD_WIDTH * k + j] = orbits[stride * k + index];
+		}
+		get_asteroid_transforms(orbit, SIMD_WIDTH, time, transforms + i * 12);
+	}
+}
+
+/* asteroid orbits table
+ * structure-of-arrays layout with the stride aligned to the SIMD_WIDTH
+ */
+static void get_asteroid_orbits(uint32_t stride, float32_t *orbits) {
+	AsteroidOrbit data;
+	for(uint32_t i = 0; i < stride; i++) {
+		get_asteroid_orbit(i, data);
+		const float32_t *src = (const float32_t*)&data;
+		for(uint32_t j = 0; j < ORBIT_SIZE; j++) orbits[stride * j + i] = src[j];
+	}
+}
+
+/*
+ */
+static Matrix4x3d get_asteroid_matrix(const float32_t *transform) {
+	Matrix4x3d ret;
+	ret.m00 = transform[0]; ret.m01 = transform[1]; ret.m02 = transform[2]; ret.m03 = transform[3];
+	ret.m10 = transform[4]; ret.m11 = transform[5]; ret.m12 = transform[6]; ret.m13 = transform[7];
+	ret.m20 = transform[8]; ret.m21 = transform[9]; ret.m22 = transform[10]; ret.m23 = transform[11];
+	return ret;
+}
+
 /*
  */
 class GraphAsteroids: public GraphScript {
@@ -43,11 +482,23 @@ class GraphAsteroids: public GraphScript {
 		GraphAsteroids(void *ptr) : GraphScript(ptr) {
 			
 			TS_LOGF(Message, "GraphAsteroids::GraphAsteroids(): %p\n", this);
+			
+			#if BENCHMARK_GRAVITY
+				benchmark_report.addStage("transform");
+				benchmark_report.addStage("tree");
+				benchmark_report.addStage("scene");
+			#endif
 		}
 		~GraphAsteroids() {
 			
 			TS_LOGF(Message, "GraphAsteroids::~GraphAsteroids(): %p\n", this);
 			
+			if(Trace::isEnabled() && !Trace::save("asteroids_trace.json")) TS_LOG(Error, "GraphAsteroids::~GraphAsteroids(): can't save trace\n");
+			
+			#if BENCHMARK_GRAVITY
+				if(!benchmark_report.save("asteroids_benchmark.json")) TS_LOG(Error, "GraphAsteroids::~GraphAsteroids(): can't save benchmark\n");
+			#endif
+			
 			clear();
 		}
 		
@@ -55,57 +506,183 @@ class GraphAsteroids: public GraphScript {
 		 */
 		virtual void update() {
 			
+			TRACE_ZONE("GraphAsteroids::update");
+			
+			update_asteroids();
+			
+			// the sweep is advanced on every frame
+			#if ASTEROIDS_SWEEP
+				sweep();
+			#endif
+		}
+		
+	private:
+		
+		/*
+		 */
+		void update_asteroids() {
+			
 			// create asteroids
 			if(num_indices == 0) {
+				uint64_t begin = Time::current();
 				if(!create(getDevice())) {
 					TS_LOG(Error, "GraphAsteroids::update(): can't create Asteroids\n");
 					return;
 				}
+				create_time = Time::current() - begin;
+				
+				// asteroids graph contains object nodes only
+				// the light tree doesn't depend on the asteroid transforms
+				begin = Time::current();
+				updateLightTree();
+				light_time = Time::current() - begin;
 			}
 			
 			// transform asteroids
+			uint64_t begin = Time::current();
 			if(transform_kernel) {
 				
-				// scene storage buffer
-				Scene scene = getScene();
-				SceneManager scene_manager = scene.getManager();
-				Buffer scene_storage_buffer = scene_manager.getStorageHeapBuffer();
-				
 				// create command list
 				Device device = getDevice();
 				Compute compute = device.createCompute();
 				
-				// transform parameters
 				// time previous scene time is used because the scene time has been updated
 				// but our camera transformation is from the previous frame
 				// using current time can lead to asteroids jittering
-				struct TransformParameters {
-					uint32_t node_address;
-					uint32_t num_indices;
-					float32_t time;
-				};
-				TransformParameters transform_parameters;
-				transform_parameters.node_address = getNodeAddress();
-				transform_parameters.num_indices = num_indices;
-				transform_parameters.time = time;
+				Scene scene = getScene();
+				if(camera_node) {
+					uint32_t size = cull(time);
+					for(uint32_t i = 0; i < size; i++) {
+						uint32_t index = visible_indices[i];
+						visible_data[i * 2 + 0] = index;
+						visible_data[i * 2 + 1] = (node_base != Maxu32) ? node_base + index : node_indices[index];
+					}
+					if(size) {
+						device.setBuffer(visible_buffer, visible_data.get(), sizeof(uint32_t) * 2 * size);
+						dispatch(compute, culling_kernel, visible_buffer, size, time);
+					}
+					transform_count += size;
+					time = (float32_t)scene.getTime();
+					if(size == 0) return;
+				} else {
+					dispatch(compute, transform_kernel, indices_buffer, num_indices, time);
+					time = (float32_t)scene.getTime();
+					transform_count += num_indices;
+				}
+			}
+			
+			// replay recorded transforms
+			#if REPLAY_TRANSFORMS
+				else if(nodes) {
+					float64_t replay_time = 0.0;
+					if(!reader.read(replay_time) || !reader.getChanged()) return;
+					for(uint32_t index : reader.getChanged()) {
+						nodes[index].setGlobalTransform(get_asteroid_matrix(reader.getTransform(index)));
+					}
+				}
+			#endif
+			
+			// transform asteroids on CPU
+			else if(nodes) {
+				
+				// same time shift as on the GPU
+				Scene scene = getScene();
+				float32_t t = time;
 				time = (float32_t)scene.getTime();
 				
-				// set transform kernel
-				compute.setKernel(transform_kernel);
-				compute.setUniform(0, transform_parameters);
-				compute.setStorageBuffer(0, indices_buffer);
-				compute.setStorageBuffer(1, scene_storage_buffer);
-				compute.dispatch(num_indices);
-				compute.barrier(scene_storage_buffer);
+				// node transforms are persistent
+				// nothing moves while the scene time is paused
+				uint32_t size = num_indices;
+				const uint32_t *indices = nullptr;
+				if(camera_node) {
+					size = cull(t);
+					indices = visible_indices.get();
+				} else if(t == nodes_time) {
+					size = 0;
+				}
+				if(size == 0) return;
+				nodes_time = t;
+				transform(t, indices, size);
+				transform_count += size;
 				
-				// update graph
-				updateLightTree();
-				updateObjectTree();
-				updateScene();
+				// set node transforms
+				const float32_t *data = transforms.get();
+				for(uint32_t i = 0; i < size; i++, data += 12) {
+					nodes[indices ? indices[i] : i].setGlobalTransform(get_asteroid_matrix(data));
+				}
+				
+				#if RECORD_TRANSFORMS
+					recorder.record(t, transforms.get(), indices, size);
+				#endif
+			}
+			else {
+				return;
 			}
+			uint64_t end = Time::current();
+			transform_time += end - begin;
+			#if BENCHMARK_GRAVITY
+				benchmark_report.append(BenchmarkTransform, end - begin);
+			#endif
+			
+			// update graph
+			begin = end;
+			updateObjectTree();
+			end = Time::current();
+			tree_time += end - begin;
+			if(Trace::isEnabled()) Trace::append("GraphAsteroids::updateObjectTree", begin, end);
+			#if BENCHMARK_GRAVITY
+				benchmark_report.append(BenchmarkTree, end - begin);
+			#endif
+			begin = end;
+			updateScene();
+			end = Time::current();
+			scene_time += end - begin;
+			if(Trace::isEnabled()) Trace::append("GraphAsteroids::updateScene", begin, end);
+			#if BENCHMARK_GRAVITY
+				benchmark_report.append(BenchmarkScene, end - begin);
+			#endif
 		}
 		
-	private:
+		/* dispatch transform kernel
+		 */
+		void dispatch(Compute &compute, Kernel &kernel, Buffer &buffer, uint32_t size, float32_t t) {
+			
+			TRACE_ZONE("GraphAsteroids::dispatch");
+			
+			// scene storage buffer
+			Scene scene = getScene();
+			SceneManager scene_manager = scene.getManager();
+			Buffer scene_storage_buffer = scene_manager.getStorageHeapBuffer();
+			
+			// transform parameters
+			struct TransformParameters {
+				uint32_t node_address;
+				uint32_t node_base;
+				uint32_t num_indices;
+				uint32_t orbit_stride;
+				float32_t time;
+			};
+			TransformParameters transform_parameters;
+			transform_parameters.node_address = getNodeAddress();
+			transform_parameters.node_base = node_base;
+			transform_parameters.num_indices = size;
+			transform_parameters.orbit_stride = orbit_stride;
+			transform_parameters.time = t;
+			
+			// set transform kernel
+			compute.setKernel(kernel);
+			compute.setUniform(0, transform_parameters);
+			if(buffer) {
+				compute.setStorageBuffer(0, buffer);
+				compute.setStorageBuffer(1, orbits_buffer);
+				compute.setStorageBuffer(2, scene_storage_buffer);
+			} else {
+				compute.setStorageBuffer(0, orbits_buffer);
+				compute.setStorageBuffer(1, scene_storage_buffer);
+			}
+			compute.dispatch(size);
+			compute.barrier(scene_storage_buffer);
+		}
 		
 		/*
 		 */
@@ -130,11 +707,10 @@ class GraphAsteroids: public GraphScript {
 			}
 			
 			// get scene asteroids
+			Array<uint32_t> indices;
+			findIndexedNames(scene.getNumObjects(), "Asteroid_", [&scene](uint32_t index) { return scene.getObject(index).getName(); }, indices);
 			Array<Object> asteroids;
-			for(uint32_t i = 0; i < Maxu16; i++) {
-				String name = String::format("Asteroid_%02u", i);
-				uint32_t index = scene.findObject(name.get());
-				if(index == Maxu32) break;
+			for(uint32_t index : indices) {
 				Object object = scene.getObject(index);
 				if(object) asteroids.append(object);
 			}
@@ -152,55 +728,545 @@ class GraphAsteroids: public GraphScript {
 			node_surface.updateScene();
 			node_depth.updateScene();
 			
+			// transform path
+			bool use_kernel = (device && device.hasShader(Shader::TypeCompute));
+			#if CPU_TRANSFORM || RECORD_TRANSFORMS || REPLAY_TRANSFORMS
+				use_kernel = false;
+			#endif
+			
 			// create asteroids
+			// CPU path keeps node handles
+			uint64_t begin = Time::current();
+			Array<uint32_t> indices_data;
+			node_base = create_nodes(asteroids, num_asteroids, hash, indices_data, !use_kernel);
+			num_indices = indices_data.size();
+			uint64_t create_nodes_time = Time::current() - begin;
+			TS_LOGF(Message, "GraphAsteroids::create(): %u nodes %s %.1f ns per node%s\n", num_indices, String::fromTime(create_nodes_time).get(),
+				create_nodes_time * 1000.0 / max(num_indices, 1u), (node_base != Maxu32) ? " contiguous" : "");
+			
+			// create orbits table
+			// orbit parameters are constant for each asteroid
+			orbit_stride = align(num_indices, SIMD_WIDTH);
+			orbits.resize(orbit_stride * ORBIT_SIZE);
+			get_asteroid_orbits(orbit_stride, orbits.get());
+			
+			// create culling bins
+			// the sweep measures all asteroids independently of the camera
+			#if ASTEROIDS_CULLING && !ASTEROIDS_SWEEP
+				if(!use_kernel || KERNEL_CULLING) create_culling(gravity_graph);
+			#endif
+			
+			// compute shader path
+			if(use_kernel) {
+				
+				// create indices buffer
+				String defines = "COMPUTE_SHADER=1";
+				if(node_base == Maxu32) {
+					indices_buffer = device.createBuffer(Buffer::FlagStorage, indices_data.get(), indices_data.bytes());
+					if(!indices_buffer) {
+						TS_LOG(Error, "GraphAsteroids::create(): can't create indices buffer\n");
+						return false;
+					}
+				} else {
+					defines += "; NODE_RANGE=1";
+				}
+				
+				// create orbits buffer
+				orbits_buffer = device.createBuffer(Buffer::FlagStorage, orbits.get(), orbits.bytes());
+				if(!orbits_buffer) {
+					TS_LOG(Error, "GraphAsteroids::create(): can't create orbits buffer\n");
+					return false;
+				}
+				
+				// create transform kernel
+				transform_kernel = device.createKernel().setUniforms(1).setStorages(indices_buffer ? 3 : 2);
+				transform_kernel.loadShaderGLSL("shaders/transform.shader", defines.get());
+				if(!transform_kernel.create()) {
+					TS_LOG(Error, "GraphAsteroids::create(): can't create transform kernel\n");
+					return false;
+				}
+				
+				// create culling kernel
+				if(camera_node) {
+					if(node_base == Maxu32) node_indices = indices_data;
+					visible_data.resize(num_indices * 2);
+					visible_buffer = device.createBuffer(Buffer::FlagStorage, visible_data.bytes());
+					culling_kernel = device.createKernel().setUniforms(1).setStorages(3);
+					culling_kernel.loadShaderGLSL("shaders/transform.shader", (defines + "; CULLING=1").get());
+					if(!visible_buffer || !culling_kernel.create()) {
+						TS_LOG(Error, "GraphAsteroids::create(): can't create culling kernel\n");
+						return false;
+					}
+				}
+				
+				#if BENCHMARK_TRANSFORM
+					benchmark(defines);
+				#endif
+				
+				// orbits are on the GPU
+				orbits.release();
+				memory = (indices_buffer ? indices_buffer.getSize() : 0) + orbits_buffer.getSize();
+				
+				return true;
+			}
+			
+			// CPU path
+			// worker threads are persistent across frames and sweep steps
+			if(workers.getNumThreads() == 1) workers.create(clamp(std::thread::hardware_concurrency(), 1u, (uint32_t)MaxThreads));
+			TS_LOGF(Message, "GraphAsteroids::create(): CPU transform %u-wide %u threads\n", SIMD_WIDTH, workers.getNumThreads());
+			transforms.resize(align(num_indices, SIMD_WIDTH) * 12);
+			memory = nodes.bytes() + orbits.bytes() + transforms.bytes();
+			
+			// compare with the scalar reference
+			#if VALIDATE_TRANSFORM
+				if(!validate()) return false;
+			#endif
+			
+			// transform stream
+			#if RECORD_TRANSFORMS
+				if(!recorder.open("asteroids.rec", num_indices)) TS_LOG(Error, "GraphAsteroids::create(): can't create recorder\n");
+			#elif REPLAY_TRANSFORMS
+				if(!reader.open("asteroids.rec") || reader.getNumNodes() != num_indices) {
+					TS_LOG(Error, "GraphAsteroids::create(): can't open asteroids.rec\n");
+					return false;
+				}
+			#endif
+			
+			#if BENCHMARK_TRANSFORM
+				benchmark(String());
+			#endif
+			
+			return true;
+		}
+		
+		/* create asteroid nodes
+		 * the per-node NodeObject loop with preallocated indices and node handles
+		 * returns the first node index when the node indices are contiguous or Maxu32
+		 * contiguous indices let the kernel derive node indices without the indices buffer
+		 */
+		uint32_t create_nodes(Array<Object> &objects, uint32_t size, uint32_t hash, Array<uint32_t> &indices, bool handles) {
+			
 			Random<> random(0u);
-			uint32_t num_asteroids = 200000;
-			Array<uint32_t> indices_data(num_asteroids);
-			for(uint32_t i = 0; i < num_asteroids; i++) {
-				Object &object = asteroids[random.geti32(0, asteroids.size() - 1)];
+			indices.resize(size);
+			if(handles) nodes.reserve(size);
+			
+			bool contiguous = true;
+			for(uint32_t i = 0; i < size; i++) {
+				Object &object = objects[random.geti32(0, objects.size() - 1)];
 				NodeObject node_object(*this, object);
-				indices_data[i] = node_object.getIndex();
+				indices[i] = node_object.getIndex();
 				hash = node_object.setMotionHash(hash);
 				node_object.setInternal(true);
+				if(handles) nodes.append(node_object);
+				contiguous &= (indices[i] == indices[0] + i);
 			}
 			
-			// create indices buffer
-			indices_buffer = device.createBuffer(Buffer::FlagStorage, indices_data.get(), indices_data.bytes());
-			if(!indices_buffer) {
-				TS_LOG(Error, "GraphAsteroids::create(): can't create indices buffer\n");
-				return false;
+			return (size && contiguous) ? indices[0] : Maxu32;
+		}
+		
+		/* create culling
+		 * asteroids are binned by the orbit ring and the angular sector
+		 * the last bin is always visible and marks asteroids which were never transformed
+		 */
+		bool create_culling(Graph &gravity_graph) {
+			
+			// culling camera
+			camera_node = gravity_graph.getNode("Camera_0");
+			if(!camera_node) return false;
+			
+			// orbit ranges
+			const float32_t *translate_x = orbits.get() + orbit_stride * 3;
+			const float32_t *translate_y = orbits.get() + orbit_stride * 4;
+			const float32_t *translate_z = orbits.get() + orbit_stride * 5;
+			float32_t min_radius = Maxf32, max_radius = 0.0f;
+			float32_t min_z = Maxf32, max_z = -Maxf32;
+			for(uint32_t i = 0; i < num_indices; i++) {
+				float32_t radius = sqrtf(translate_x[i] * translate_x[i] + translate_y[i] * translate_y[i]);
+				min_radius = min(min_radius, radius);
+				max_radius = max(max_radius, radius);
+				min_z = min(min_z, translate_z[i]);
+				max_z = max(max_z, translate_z[i]);
 			}
-			num_indices = indices_data.size();
 			
-			// create transform kernel
-			transform_kernel = device.createKernel().setUniforms(1).setStorages(2);
-			transform_kernel.loadShaderGLSL("shaders/transform.shader", "COMPUTE_SHADER=1");
-			if(!transform_kernel.create()) {
-				TS_LOG(Error, "GraphAsteroids::create(): can't create transform kernel\n");
-				return false;
+			// ring and sector bounds
+			float32_t ring_size = (max_radius - min_radius) / CullingRings;
+			float32_t sector_angle = 3.14159265f / CullingSectors;
+			culling_bins.resize(CullingRings * CullingSectors + 1);
+			culling_visible.resize(culling_bins.size());
+			for(uint32_t i = 0; i < CullingRings; i++) {
+				float32_t radius_0 = min_radius + ring_size * i;
+				float32_t radius_1 = radius_0 + ring_size;
+				float32_t radius = (radius_0 + radius_1) * 0.5f;
+				float32_t size_x = ring_size * 0.5f + radius_0 * (1.0f - cosf(sector_angle));
+				float32_t size_y = radius_1 * sinf(sector_angle);
+				float32_t size_z = (max_z - min_z) * 0.5f;
+				for(uint32_t j = 0; j < CullingSectors; j++) {
+					CullingBin &bin = culling_bins[CullingSectors * i + j];
+					float32_t angle = sector_angle * (j * 2 + 1);
+					bin.center = Vector3f(cosf(angle) * radius, sinf(angle) * radius, (min_z + max_z) * 0.5f);
+					bin.radius = sqrtf(size_x * size_x + size_y * size_y + size_z * size_z) + CullingMargin;
+				}
+			}
+			culling_visible[CullingRings * CullingSectors] = 1;
+			
+			// asteroid phases and rings
+			const float32_t *offset_sin = orbits.get();
+			const float32_t *offset_cos = orbits.get() + orbit_stride;
+			const float32_t *angle_speed = orbits.get() + orbit_stride * 2;
+			culling_phases.resize(num_indices);
+			culling_speeds.resize(num_indices);
+			culling_rings.resize(num_indices);
+			culling_last.resize(num_indices);
+			culling_times.resize(num_indices);
+			for(uint32_t i = 0; i < num_indices; i++) {
+				float32_t radius = sqrtf(translate_x[i] * translate_x[i] + translate_y[i] * translate_y[i]);
+				uint32_t ring = min((uint32_t)((radius - min_radius) / max(ring_size, 1e-6f)), (uint32_t)CullingRings - 1);
+				culling_phases[i] = atan2f(translate_y[i], translate_x[i]) + atan2f(offset_sin[i], offset_cos[i]);
+				culling_speeds[i] = angle_speed[i];
+				culling_rings[i] = (uint16_t)(CullingSectors * ring);
+				culling_last[i] = (uint16_t)(CullingRings * CullingSectors);
+				culling_times[i] = Maxf32;
 			}
+			visible_indices.resize(orbit_stride);
 			
 			return true;
 		}
 		
+		/* asteroids culling
+		 * bins are tested against the camera cone in the graph space
+		 * an asteroid is transformed when its current or last transformed bin is visible
+		 */
+		uint32_t cull(float32_t t) {
+			
+			TRACE_ZONE("GraphAsteroids::cull");
+			
+			// camera cone in the graph space
+			// the half-angle covers the frustum corners of the widest viewport
+			Matrix4x3d transform = inverse(getTransform()) * camera_node.getGlobalTransform();
+			Vector3f position = Vector3f((float32_t)transform.m03, (float32_t)transform.m13, (float32_t)transform.m23);
+			Vector3f direction = -normalize(Vector3f((float32_t)transform.m02, (float32_t)transform.m12, (float32_t)transform.m22));
+			NodeCamera node_camera = NodeCamera(camera_node);
+			float32_t fov = (node_camera) ? node_camera.getCamera().getFov() : 0.0f;
+			float32_t angle = CULLING_ANGLE * 0.0174532925f;
+			if(fov > 0.0f) angle = atanf(tanf(fov * 0.5f * 0.0174532925f) * sqrtf(1.0f + CULLING_ASPECT * CULLING_ASPECT));
+			
+			// visible bins
+			for(uint32_t i = 0; i < CullingRings * CullingSectors; i++) {
+				const CullingBin &bin = culling_bins[i];
+				Vector3f bin_direction = bin.center - position;
+				float32_t distance = length(bin_direction);
+				if(distance <= bin.radius) culling_visible[i] = 1;
+				else culling_visible[i] = (acosf(clamp(dot(direction, bin_direction) / distance, -1.0f, 1.0f)) <= angle + asinf(bin.radius / distance));
+			}
+			
+			// visible asteroids
+			uint32_t size = 0;
+			for(uint32_t i = 0; i < num_indices; i++) {
+				if(culling_times[i] == t) continue;
+				float32_t sector = (culling_phases[i] + culling_speeds[i] * t) * 0.159154943f;
+				uint32_t bin = culling_rings[i] + min((uint32_t)((sector - floorf(sector)) * CullingSectors), (uint32_t)CullingSectors - 1);
+				if(!culling_visible[bin] && !culling_visible[culling_last[i]]) continue;
+				culling_last[i] = (uint16_t)bin;
+				culling_times[i] = t;
+				visible_indices[size++] = i;
+			}
+			
+			// padding for SIMD blocks
+			for(uint32_t i = size; i < align(size, SIMD_WIDTH); i++) {
+				visible_indices[i] = visible_indices[size - 1];
+			}
+			
+			// culling counters
+			num_processed += size;
+			num_culled += num_indices - size;
+			if(++culling_frame == 60) {
+				TS_LOGF(Message, "GraphAsteroids::cull(): processed %u culled %u\n", (uint32_t)(num_processed / culling_frame), (uint32_t)(num_culled / culling_frame));
+				culling_frame = 0;
+				num_processed = 0;
+				num_culled = 0;
+			}
+			
+			return size;
+		}
+		
+		/* transform asteroids on CPU
+		 * all asteroids or the visible asteroid indices
+		 */
+		void transform(float32_t t, const uint32_t *indices, uint32_t size) {
+			
+			TRACE_ZONE("GraphAsteroids::transform");
+			
+			// split blocks into jobs
+			// a few jobs per thread balance the visible ranges
+			if(size == 0) return;
+			uint32_t num_blocks = udiv(size, SIMD_WIDTH);
+			uint32_t num_jobs = min(workers.getNumThreads() * 4, num_blocks);
+			uint32_t step = udiv(num_blocks, num_jobs) * SIMD_WIDTH;
+			size = num_blocks * SIMD_WIDTH;
+			
+			// run worker threads
+			const float32_t *orbits_data = orbits.get();
+			float32_t *transforms_data = transforms.get();
+			workers.run(udiv(size, step), [&](uint32_t index) {
+				uint32_t begin = step * index;
+				uint32_t end = min(begin + step, size);
+				if(indices) transform_visible_asteroids(begin, end, t, indices, orbits_data, orbit_stride, transforms_data);
+				else transform_asteroids(begin, end, t, orbits_data, orbit_stride, transforms_data);
+			});
+		}
+		
+		#if VALIDATE_TRANSFORM
+			
+			/* validate CPU transforms
+			 * the float64 reference is independent of the float32 argument rounding and FMA contraction
+			 * errors are relative to the rounding of the largest angle argument
+			 * one argument ulp moves the basis by the scale and the translation by its length
+			 */
+			bool validate() {
+				
+				const float32_t times[] = { 0.0f, 1.0f, 60.0f, 3600.0f, 36000.0f };
+				
+				float64_t basis_error = 0.0;
+				float64_t translate_error = 0.0;
+				for(float32_t t : times) {
+					transform(t, nullptr, num_indices);
+					for(uint32_t i = 0; i < num_indices; i++) {
+						float64_t reference[12];
+						float64_t argument = get_asteroid_transform(i, t, reference);
+						float64_t angle_error = (1.0 + argument) * FLT_EPSILON * 8.0;
+						float64_t basis_tolerance = orbits[orbit_stride * 6 + i] * angle_error;
+						float64_t translate_tolerance = sqrt(reference[3] * reference[3] + reference[7] * reference[7] + reference[11] * reference[11]) * angle_error;
+						const float32_t *data = transforms.get() + i * 12;
+						for(uint32_t j = 0; j < 12; j++) {
+							float64_t error = fabs(data[j] - reference[j]);
+							if((j & 3) == 3) translate_error = max(translate_error, error / translate_tolerance);
+							else basis_error = max(basis_error, error / basis_tolerance);
+						}
+					}
+				}
+				
+				TS_LOGF(Message, "GraphAsteroids::validate(): basis %.2f translate %.2f of the tolerance\n", basis_error, translate_error);
+				if(basis_error > 1.0 || translate_error > 1.0) {
+					TS_LOG(Error, "GraphAsteroids::validate(): CPU transform mismatch\n");
+					return false;
+				}
+				
+				return true;
+			}
+			
+		#endif
+		
+		#if BENCHMARK_TRANSFORM
+			
+			/* per-asteroid transform cost
+			 * per-frame orbit parameters versus the orbits table
+			 * the CPU kernels process the padded orbit stride, so it is the CPU divisor
+			 */
+			void benchmark(const String &defines) {
+				
+				const uint32_t num_frames = 16;
+				uint32_t num_transforms = num_indices * num_frames;
+				
+				// single thread CPU transform
+				Array<float32_t> data(orbit_stride * 12);
+				uint64_t noise_time = Time::current();
+				for(uint32_t i = 0; i < num_frames; i++) transform_asteroids(0, orbit_stride, (float32_t)i, nullptr, orbit_stride, data.get());
+				noise_time = Time::current() - noise_time;
+				uint64_t table_time = Time::current();
+				for(uint32_t i = 0; i < num_frames; i++) transform_asteroids(0, orbit_stride, (float32_t)i, orbits.get(), orbit_stride, data.get());
+				table_time = Time::current() - table_time;
+				uint32_t num_cpu_transforms = orbit_stride * num_frames;
+				TS_LOGF(Message, "GraphAsteroids::benchmark(): CPU %.2f ns -> %.2f ns per asteroid\n", noise_time * 1000.0 / num_cpu_transforms, table_time * 1000.0 / num_cpu_transforms);
+				
+				// compute shader transform
+				if(transform_kernel) {
+					
+					Device device = getDevice();
+					Kernel noise_kernel = device.createKernel().setUniforms(1).setStorages(indices_buffer ? 3 : 2);
+					noise_kernel.loadShaderGLSL("shaders/transform.shader", (defines + "; ORBIT_NOISE=1").get());
+					if(!noise_kernel.create()) return;
+					
+					auto get_time = [&](Kernel &kernel) -> uint64_t {
+						device.finish();
+						uint64_t begin = Time::current();
+						{
+							Compute compute = device.createCompute();
+							for(uint32_t i = 0; i < num_frames; i++) dispatch(compute, kernel, indices_buffer, num_indices, (float32_t)i);
+						}
+						device.flush();
+						device.finish();
+						return Time::current() - begin;
+					};
+					
+					noise_time = get_time(noise_kernel);
+					table_time = get_time(transform_kernel);
+					TS_LOGF(Message, "GraphAsteroids::benchmark(): GPU %.2f ns -> %.2f ns per asteroid\n", noise_time * 1000.0 / num_transforms, table_time * 1000.0 / num_transforms);
+				}
+			}
+			
+		#endif
+		
+		#if ASTEROIDS_SWEEP
+			
+			/* asteroids scaling sweep
+			 * each count is measured over SweepFrames frames and saved into asteroids_sweep.csv
+			 * the transformed column is the average number of asteroids processed per frame
+			 * script memory is the size of the asteroid buffers and arrays
+			 * process memory is the resident set size where it is available
+			 */
+			void sweep() {
+				
+				static const uint32_t counts[] = { 10000, 50000, 200000, 1000000, 4000000 };
+				
+				if(sweep_index == TS_COUNTOF(counts) || num_indices == 0) return;
+				if(++sweep_frame < SweepFrames) return;
+				
+				// report results
+				// the file is rewritten after each count to keep partial results
+				if(sweep_index == 0) sweep_report = "asteroids,create_ms,light_ms,transformed,transform_ms,tree_ms,scene_ms,script_mb,process_mb\n";
+				String row = String::format("%u,%.3f,%.3f,%u,%.3f,%.3f,%.3f,%.2f,%.2f\n", num_indices, create_time / 1000.0, light_time / 1000.0,
+					(uint32_t)(transform_count / sweep_frame), transform_time / (1000.0 * sweep_frame), tree_time / (1000.0 * sweep_frame), scene_time / (1000.0 * sweep_frame),
+					memory / (1024.0 * 1024.0), getProcessMemory() / (1024.0 * 1024.0));
+				sweep_report += row;
+				TS_LOGF(Message, "GraphAsteroids::sweep(): %s", row.get());
+				File file;
+				if(!file.open("asteroids_sweep.csv", "wb") || file.write(sweep_report.get(), sweep_report.size()) != sweep_report.size()) {
+					TS_LOG(Error, "GraphAsteroids::sweep(): can't save asteroids_sweep.csv\n");
+				}
+				
+				// next count
+				if(++sweep_index < TS_COUNTOF(counts)) {
+					num_asteroids = counts[sweep_index];
+					clear();
+				} else {
+					TS_LOGF(Message, "GraphAsteroids::sweep(): done\n%s", sweep_report.get());
+				}
+				sweep_frame = 0;
+				transform_count = 0;
+				transform_time = 0;
+				tree_time = 0;
+				scene_time = 0;
+			}
+			
+		#endif
+		
 		/*
 		 */
 		void clear() {
 			
+			// close transform stream
+			#if RECORD_TRANSFORMS
+				recorder.close();
+				if(recorder.getRawBytes()) TS_LOGF(Message, "GraphAsteroids::clear(): recorded %.1f MB/s ratio %.1f\n", recorder.getThroughput(), recorder.getRatio());
+			#endif
+			
 			// release nodes
+			nodes.clear();
 			releaseNodes();
 			updateScene();
 			
 			// clear resources
 			indices_buffer.clear();
+			orbits_buffer.clear();
 			transform_kernel.clearPtr();
+			transforms.clear();
+			orbits.clear();
+			
+			// clear culling
+			camera_node.clearPtr();
+			visible_buffer.clear();
+			culling_kernel.clearPtr();
+			culling_bins.clear();
+			culling_visible.clear();
+			culling_phases.clear();
+			culling_speeds.clear();
+			culling_rings.clear();
+			culling_last.clear();
+			culling_times.clear();
+			visible_indices.clear();
+			visible_data.clear();
+			node_indices.clear();
 			
 			num_indices = 0;
+			node_base = Maxu32;
+			nodes_time = Maxf32;
+			memory = 0;
 		}
 		
 		float32_t time = 0.0f;
 		
 		Buffer indices_buffer;
+		Buffer orbits_buffer;
 		Kernel transform_kernel;
 		uint32_t num_indices = 0;
+		uint32_t node_base = Maxu32;
+		uint32_t orbit_stride = 0;
+		
+		enum {
+			MaxThreads = 64,
+			SweepFrames = 64,
+			CullingRings = 8,
+			CullingSectors = 256,
+			CullingMargin = 128,
+		};
+		
+		#if BENCHMARK_GRAVITY
+			enum {
+				BenchmarkTransform = 0,
+				BenchmarkTree,
+				BenchmarkScene,
+			};
+			BenchmarkReport benchmark_report = BenchmarkReport("asteroids");
+		#endif
+		
+		#if ASTEROIDS_SWEEP
+			uint32_t num_asteroids = 10000;
+			uint32_t sweep_index = 0;
+			uint32_t sweep_frame = 0;
+			String sweep_report;
+		#else
+			uint32_t num_asteroids = get_num_asteroids();
+		#endif
+		
+		size_t memory = 0;
+		uint64_t create_time = 0;
+		uint64_t light_time = 0;
+		uint64_t transform_time = 0;
+		uint64_t transform_count = 0;
+		uint64_t tree_time = 0;
+		uint64_t scene_time = 0;
+		
+		Array<Node> nodes;
+		float32_t nodes_time = Maxf32;
+		WorkerPool workers;
+		Array<float32_t> orbits;
+		Array<float32_t> transforms;
+		
+		struct CullingBin {
+			Vector3f center;
+			float32_t radius;
+		};
+		
+		Node camera_node;
+		Buffer visible_buffer;
+		Kernel culling_kernel;
+		Array<CullingBin> culling_bins;
+		Array<uint8_t> culling_visible;
+		Array<float32_t> culling_phases;
+		Array<float32_t> culling_speeds;
+		Array<uint16_t> culling_rings;
+		Array<uint16_t> culling_last;
+		Array<float32_t> culling_times;
+		Array<uint32_t> visible_indices;
+		Array<uint32_t> visible_data;
+		Array<uint32_t> node_indices;
+		uint64_t num_processed = 0;
+		uint64_t num_culled = 0;
+		uint32_t culling_frame = 0;
+		
+		#if RECORD_TRANSFORMS
+			TransformRecorder recorder;
+		#elif REPLAY_TRANSFORMS
+			TransformReader reader;
+		#endif
 };
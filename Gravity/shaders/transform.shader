@@ -28,12 +28,30 @@
 	
 	layout(std140, binding = 0) uniform TransformParameters {
 		uint node_address;
+		uint node_base;
 		uint num_asteroids;
+		uint orbit_stride;
 		float time;
 	};
 	
-	layout(std430, binding = 1) readonly buffer IndicesBuffer { uint node_indices_buffer[]; };
-	layout(std430, binding = 2) buffer StorageBuffer { vec4 scene_storage_buffer[]; };
+	// visible asteroid and node indices
+	// contiguous node indices don't need the indices buffer
+	#if CULLING
+		layout(std430, binding = 1) readonly buffer VisibleBuffer { uvec2 visible_buffer[]; };
+	#elif !NODE_RANGE
+		layout(std430, binding = 1) readonly buffer IndicesBuffer { uint node_indices_buffer[]; };
+	#endif
+	
+	#if CULLING || !NODE_RANGE
+		#define ORBITS_BINDING	2
+		#define STORAGE_BINDING	3
+	#else
+		#define ORBITS_BINDING	1
+		#define STORAGE_BINDING	2
+	#endif
+	
+	layout(std430, binding = ORBITS_BINDING) readonly buffer OrbitsBuffer { float orbits_buffer[]; };
+	layout(std430, binding = STORAGE_BINDING) buffer StorageBuffer { vec4 scene_storage_buffer[]; };
 	
 	/*
 	 */
@@ -45,24 +63,22 @@
 	#include <SceneNodes.shader>
 	#include <SceneMath.shader>
 	
-	/*
-	 */
-	float halton2(uint i) {
-		uint bits = (i << 16u) | (i >> 16u);
-		bits = ((bits & 0x00ff00ffu) << 8u) | ((bits & 0xff00ff00u) >> 8u);
-		bits = ((bits & 0x0f0f0f0fu) << 4u) | ((bits & 0xf0f0f0f0u) >> 4u);
-		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xccccccccu) >> 2u);
-		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xaaaaaaaau) >> 1u);
-		return float(bits) * 2.3283064365386963e-10f;
-	}
-	
-	/*
-	 */
-	void main() {
+	#if ORBIT_NOISE
 		
-		uint global_id = gl_GlobalInvocationID.x;
+		/*
+		 */
+		float halton2(uint i) {
+			uint bits = (i << 16u) | (i >> 16u);
+			bits = ((bits & 0x00ff00ffu) << 8u) | ((bits & 0xff00ff00u) >> 8u);
+			bits = ((bits & 0x0f0f0f0fu) << 4u) | ((bits & 0xf0f0f0f0u) >> 4u);
+			bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xccccccccu) >> 2u);
+			bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xaaaaaaaau) >> 1u);
+			return float(bits) * 2.3283064365386963e-10f;
+		}
 		
-		[[branch]] if(global_id < num_asteroids) {
+		/* orbit parameters from the asteroid index
+		 */
+		mat3x4 get_transform(uint global_id) {
 			
 			float k = halton2(global_id);
 			
@@ -83,9 +99,60 @@
 			vec3 translate = vec3(2000.0f + range, sin(noise_0 * 31.7f) * noise * 213.0f, sin(noise * 13.7f) * 217.0f * (noise_0 * noise_2 + (k - 0.5f) * 0.1f));
 			
 			mat3x4 transform = mat4x3_compose(translate, rotate, scale);
-			transform = mat4x3_mul(mat4x3_mul(mat4x3_rotate_z(offset), mat4x3_rotate_z(angle)), transform);
+			return mat4x3_mul(mat4x3_mul(mat4x3_rotate_z(offset), mat4x3_rotate_z(angle)), transform);
+		}
+		
+	#else
+		
+		/* orbit parameters from the precomputed table
+		 * see AsteroidOrbit structure in scripts/asteroids.cpp
+		 */
+		float get_orbit(uint index, uint global_id) {
+			return orbits_buffer[orbit_stride * index + global_id];
+		}
+		
+		mat3x4 get_transform(uint global_id) {
+			
+			float rotate_x = get_orbit(7u, global_id) + get_orbit(10u, global_id) * time;
+			float rotate_y = get_orbit(8u, global_id) + get_orbit(11u, global_id) * time;
+			float rotate_z = get_orbit(9u, global_id) + get_orbit(12u, global_id) * time;
+			vec4 rotate = quat_rotate_zyx(vec3(rotate_x, rotate_y, rotate_z));
+			vec3 translate = vec3(get_orbit(3u, global_id), get_orbit(4u, global_id), get_orbit(5u, global_id));
+			vec3 scale = vec3(get_orbit(6u, global_id));
+			
+			mat3x4 transform = mat4x3_compose(translate, rotate, scale);
+			
+			// offset and angle rotations around the Z axis
+			float angle = time * get_orbit(2u, global_id);
+			float sin_offset = get_orbit(0u, global_id);
+			float cos_offset = get_orbit(1u, global_id);
+			float s = sin_offset * cos(angle) + cos_offset * sin(angle);
+			float c = cos_offset * cos(angle) - sin_offset * sin(angle);
+			return mat4x3_mul(mat3x4(c, -s, 0.0f, 0.0f, s, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f), transform);
+		}
+		
+	#endif
+	
+	/*
+	 */
+	void main() {
+		
+		uint global_id = gl_GlobalInvocationID.x;
+		
+		[[branch]] if(global_id < num_asteroids) {
 			
-			uint node_index = node_indices_buffer[global_id];
+			#if CULLING
+				uvec2 visible = visible_buffer[global_id];
+				mat3x4 transform = get_transform(visible.x);
+				uint node_index = visible.y;
+			#else
+				mat3x4 transform = get_transform(global_id);
+				#if NODE_RANGE
+					uint node_index = node_base + global_id;
+				#else
+					uint node_index = node_indices_buffer[global_id];
+				#endif
+			#endif
 			set_node_global_transform(node_address, node_index, transform);
 		}
 	}
@@ -21,6 +21,81 @@
 // SOFTWARE.
 
 #include <core/TellusimLog.h>
+#include <core/TellusimFile.h>
+
+/* physics thread
+ * simulation steps run on a dedicated thread at the fixed PHYSICS_RATE
+ * transforms are published to the scene on the frame thread only
+ */
+#ifndef PHYSICS_THREAD
+	#define PHYSICS_THREAD	0
+#endif
+#ifndef PHYSICS_RATE
+	#define PHYSICS_RATE	60.0
+#endif
+
+/* physics benchmark
+ * fixed number of steps on the compiled backend
+ * results are appended into physics_benchmark.jsonl for backend comparison
+ */
+#ifndef BENCHMARK_PHYSICS
+	#define BENCHMARK_PHYSICS	0
+#endif
+#ifndef BENCHMARK_STEPS
+	#define BENCHMARK_STEPS		1000
+#endif
+
+#if BENCHMARK_PHYSICS
+	#include "../../Common/benchmark.h"
+#endif
+
+#include "../../Common/trace.h"
+#include "../../Common/recorder.h"
+
+/* spawn benchmark
+ * batched and per-body graph updates at 1k, 10k, and 100k bodies
+ */
+#ifndef BENCHMARK_SPAWN
+	#define BENCHMARK_SPAWN		0
+#endif
+
+/* worlds benchmark
+ * independent worlds are created from the same scene and stepped in parallel
+ * it runs before the main world is created, so no world outlives the benchmark
+ */
+#ifndef BENCHMARK_WORLDS
+	#define BENCHMARK_WORLDS	0
+#endif
+
+/* transform recorder
+ * body transforms are recorded into physics.rec after each sync
+ * replay sets body transforms from physics.rec without the simulation
+ */
+#ifndef RECORD_TRANSFORMS
+	#define RECORD_TRANSFORMS	0
+#endif
+#ifndef REPLAY_TRANSFORMS
+	#define REPLAY_TRANSFORMS	0
+#endif
+
+/* physics reset
+ * the initial body states are restored every PHYSICS_RESET seconds
+ * the backend world is recreated from the restored scene bodies
+ * the initial states are saved into physics.snapshot and loaded from it by the next runs
+ */
+#ifndef PHYSICS_RESET
+	#define PHYSICS_RESET		0
+#endif
+
+#if PHYSICS_THREAD || BENCHMARK_WORLDS
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+#endif
+
+#if BENCHMARK_WORLDS
+	#include "../../Common/workers.h"
+#endif
 
 #if JOLT
 	#define PHYSICS Jolt
@@ -57,23 +132,99 @@ class GraphPhysics: public GraphScript {
 		~GraphPhysics() {
 			
 			TS_LOGF(Message, "GraphPhysics::~GraphPhysics(): %p\n", this);
+			
+			// stop physics thread
+			#if PHYSICS_THREAD
+				if(physics_thread.joinable()) {
+					{
+						std::unique_lock<std::mutex> lock(physics_mutex);
+						physics_exit = true;
+					}
+					physics_condition.notify_all();
+					physics_thread.join();
+				}
+			#endif
+			
+			#if RECORD_TRANSFORMS
+				recorder.close();
+				if(recorder.getRawBytes()) TS_LOGF(Message, "GraphPhysics::~GraphPhysics(): recorded %.1f MB/s ratio %.1f\n", recorder.getThroughput(), recorder.getRatio());
+			#endif
+			
+			if(Trace::isEnabled() && !Trace::save("physics_trace.json")) TS_LOG(Error, "GraphPhysics::~GraphPhysics(): can't save trace\n");
 		}
 		
 		/*
 		 */
 		virtual void update() {
 			
+			TRACE_ZONE("GraphPhysics::update");
+			
+			// run benchmark once
+			#if BENCHMARK_PHYSICS
+				if(initialized && physics && !benchmark_done) {
+					benchmark();
+					return;
+				}
+			#endif
+			
+			// replay recorded transforms
+			#if REPLAY_TRANSFORMS
+				if(initialized) {
+					float64_t replay_time = 0.0;
+					if(!reader.read(replay_time) || !reader.getChanged()) return;
+					for(uint32_t index : reader.getChanged()) {
+						body_nodes[index].setGlobalTransform(TransformStream::get_matrix<Matrix4x3d>(reader.getTransform(index)));
+					}
+					updateSpatial();
+					updateScene();
+					return;
+				}
+			#endif
+			
 			// update physics
 			if(initialized && physics) {
 				uint64_t begin = Time::current();
 				Scene scene = getScene();
-				physics->update();
-				physics->update(scene);
+				#if PHYSICS_RESET
+					if(scene.getTime() - reset_time > PHYSICS_RESET) {
+						restore(reset_snapshot);
+						reset_time = scene.getTime();
+					}
+				#endif
+				uint32_t frame = 0;
+				#if PHYSICS_THREAD
+					
+					// the scene is the front buffer
+					// simulation state is published after the previous steps are finished
+					// backend state is read only while the physics thread is waiting
+					wait_physics();
+					frame = physics->getFrame();
+					sync_physics(scene);
+					
+					// fixed rate steps
+					// the backlog is dropped when the frame is too slow
+					float64_t time = scene.getTime();
+					if(physics_time > time) physics_time = time;
+					uint32_t steps = 0;
+					while(physics_time + 1.0 / PHYSICS_RATE <= time && steps < MaxSteps) {
+						physics_time += 1.0 / PHYSICS_RATE;
+						steps++;
+					}
+					if(steps == MaxSteps) physics_time = time;
+					run_physics(steps);
+				#else
+					{
+						TRACE_ZONE("GraphPhysics::step");
+						physics->update();
+					}
+					frame = physics->getFrame();
+					sync_physics(scene);
+				#endif
 				simulation_time += Time::current() - begin;
-				uint32_t frames = physics->getFrame() - simulation_frame;
+				uint32_t frames = frame - simulation_frame;
 				if(frames > 60) {
 					TS_LOGF(Message, "%s\n", String::fromTime(simulation_time / frames).get());
-					simulation_frame = physics->getFrame();
+					simulation_frame = frame;
 					simulation_time = 0;
 				}
 			}
@@ -81,6 +232,8 @@ class GraphPhysics: public GraphScript {
 		
 		virtual void dispatch() {
 			
+			TRACE_ZONE("GraphPhysics::dispatch");
+			
 			// create scene
 			if(!created) {
 				created = true;
@@ -91,16 +244,378 @@ class GraphPhysics: public GraphScript {
 			else if(!initialized) {
 				initialized = true;
 				Scene scene = getScene();
+				#if REPLAY_TRANSFORMS
+					if(!reader.open("physics.rec") || reader.getNumNodes() != body_nodes.size()) {
+						TS_LOG(Error, "GraphPhysics::dispatch(): can't open physics.rec\n");
+					}
+					return;
+				#endif
 				if(!scene.isImmutable()) {
 					TS_LOGF(Message, "GraphPhysics::dispatch(): create %s physics\n", TS_STRING(PHYSICS));
+					#if BENCHMARK_WORLDS
+						benchmark_worlds();
+					#endif
+					#if BENCHMARK_PHYSICS
+						benchmark_memory = getProcessMemory();
+					#endif
+					#if PHYSICS_RESET
+						if(load_snapshot("physics.snapshot", reset_snapshot)) {
+							set_states(reset_snapshot);
+							TS_LOGF(Message, "GraphPhysics::dispatch(): %u body states are loaded\n", reset_snapshot.size());
+						} else {
+							snapshot(reset_snapshot);
+							if(!save_snapshot("physics.snapshot", reset_snapshot)) TS_LOG(Warning, "GraphPhysics::dispatch(): can't save snapshot\n");
+						}
+						reset_time = scene.getTime();
+					#endif
 					physics = makeAutoPtr(new PHYSICS());
 					physics->create(getScene());
+					#if RECORD_TRANSFORMS
+						recorder_transforms.resize(body_nodes.size() * 12);
+						if(!recorder.open("physics.rec", body_nodes.size())) TS_LOG(Error, "GraphPhysics::dispatch(): can't create recorder\n");
+					#endif
+					#if PHYSICS_THREAD
+						physics_time = scene.getTime();
+						physics_thread = std::thread(&GraphPhysics::physics_loop, this);
+					#endif
 				}
 			}
 		}
 		
 	private:
 		
+		#if PHYSICS_THREAD
+			
+			// physics thread loop
+			void physics_loop() {
+				std::unique_lock<std::mutex> lock(physics_mutex);
+				while(true) {
+					physics_condition.wait(lock, [this] { return (physics_steps || physics_exit); });
+					if(physics_exit) break;
+					uint32_t steps = physics_steps;
+					lock.unlock();
+					for(uint32_t i = 0; i < steps; i++) {
+						TRACE_ZONE("GraphPhysics::step");
+						physics->update();
+					}
+					lock.lock();
+					physics_steps = 0;
+					physics_condition.notify_all();
+				}
+			}
+			
+			// run simulation steps
+			void run_physics(uint32_t steps) {
+				if(steps == 0) return;
+				{
+					std::unique_lock<std::mutex> lock(physics_mutex);
+					physics_steps = steps;
+				}
+				physics_condition.notify_all();
+			}
+			
+			// wait for simulation steps
+			void wait_physics() {
+				std::unique_lock<std::mutex> lock(physics_mutex);
+				physics_condition.wait(lock, [this] { return (physics_steps == 0); });
+			}
+			
+		#endif
+		
+		#if BENCHMARK_PHYSICS
+			
+			// physics benchmark
+			// backends don't expose broadphase, narrowphase, and solver timings
+			void benchmark() {
+				
+				benchmark_done = true;
+				
+				BenchmarkReport report("physics");
+				report.setValue("backend", TS_STRING(PHYSICS));
+				uint32_t step_stage = report.addStage("step");
+				uint32_t sync_stage = report.addStage("sync");
+				
+				// fixed number of steps
+				Scene scene = getScene();
+				for(uint32_t i = 0; i < BENCHMARK_STEPS; i++) {
+					uint64_t begin = Time::current();
+					physics->update();
+					uint64_t end = Time::current();
+					report.append(step_stage, end - begin);
+					physics->update(scene);
+					report.append(sync_stage, Time::current() - end);
+				}
+				
+				// memory used by the backend
+				size_t memory = getProcessMemory();
+				report.setValue("memory_mb", (memory > benchmark_memory) ? (memory - benchmark_memory) / (1024.0 * 1024.0) : 0.0);
+				
+				if(!report.save("physics_benchmark.jsonl", true, true)) TS_LOG(Error, "GraphPhysics::benchmark(): can't save report\n");
+				TS_LOGF(Message, "GraphPhysics::benchmark(): %s", report.getJSON(true).get());
+			}
+			
+		#endif
+		
+	public:
+		
+		/* snapshot file
+		 */
+		enum {
+			SnapshotMagic = ('P' | ('S' << 8) | ('N' << 16) | ('P' << 24)),
+			SnapshotVersion = 1,
+		};
+		
+		/* body state
+		 */
+		struct BodyState {
+			Matrix4x3d transform;
+			Vector3f linear_velocity;
+			Vector3f angular_velocity;
+		};
+		
+		/* physics snapshot
+		 * body transforms and velocities of the created bodies
+		 */
+		void snapshot(Array<BodyState> &states) {
+			#if PHYSICS_THREAD
+				wait_physics();
+			#endif
+			states.resize(bodies.size());
+			for(uint32_t i = 0; i < bodies.size(); i++) {
+				BodyState &state = states[i];
+				state.transform = body_nodes[i].getGlobalTransform();
+				state.linear_velocity = bodies[i].getLinearVelocity();
+				state.angular_velocity = bodies[i].getAngularVelocity();
+			}
+		}
+		
+		/* physics restore
+		 * states are pushed into the scene bodies and the backend world is recreated from them
+		 * the backend keeps its own body states, so the states alone would be overwritten by the next sync
+		 */
+		bool restore(const Array<BodyState> &states) {
+			if(states.size() != bodies.size()) {
+				TS_LOGF(Error, "GraphPhysics::restore(): %u states for %u bodies\n", states.size(), bodies.size());
+				return false;
+			}
+			#if PHYSICS_THREAD
+				wait_physics();
+			#endif
+			
+			// restore body states
+			uint64_t begin = Time::current();
+			set_states(states);
+			uint64_t restore_time = Time::current() - begin;
+			
+			// recreate the backend world from the scene
+			begin = Time::current();
+			physics = makeAutoPtr(new PHYSICS());
+			physics->create(getScene());
+			uint64_t rebuild_time = Time::current() - begin;
+			simulation_frame = 0;
+			simulation_time = 0;
+			
+			TS_LOGF(Message, "GraphPhysics::restore(): %u bodies states %s rebuild %s\n", bodies.size(), String::fromTime(restore_time).get(), String::fromTime(rebuild_time).get());
+			
+			return true;
+		}
+		
+		// push states into the scene bodies
+		void set_states(const Array<BodyState> &states) {
+			for(uint32_t i = 0; i < bodies.size(); i++) {
+				const BodyState &state = states[i];
+				body_nodes[i].setGlobalTransform(state.transform);
+				bodies[i].setLinearVelocity(state.linear_velocity);
+				bodies[i].setAngularVelocity(state.angular_velocity);
+			}
+			updateSpatial();
+			updateScene();
+		}
+		
+		/* snapshot files
+		 * header: magic, version, number of states, state size
+		 */
+		bool save_snapshot(const char *name, const Array<BodyState> &states) const {
+			File file;
+			if(!file.open(name, "wb")) return false;
+			file.writeu32(SnapshotMagic);
+			file.writeu32(SnapshotVersion);
+			file.writeu32(states.size());
+			file.writeu32(sizeof(BodyState));
+			return (file.write(states.get(), states.bytes()) == states.bytes());
+		}
+		
+		bool load_snapshot(const char *name, Array<BodyState> &states) const {
+			File file;
+			if(!file.open(name, "rb")) return false;
+			if(file.readu32() != SnapshotMagic || file.readu32() != SnapshotVersion) return false;
+			uint32_t num_states = file.readu32();
+			if(file.readu32() != sizeof(BodyState)) return false;
+			if(num_states != bodies.size() || file.getSize() != sizeof(uint32_t) * 4 + sizeof(BodyState) * (size_t)num_states) return false;
+			states.resize(num_states);
+			return (file.read(states.get(), states.bytes()) == states.bytes());
+		}
+		
+	private:
+		
+		#if BENCHMARK_WORLDS
+			
+			// step independent worlds
+			// worlds are taken from the atomic job index of the pool
+			static void step_worlds(WorkerPool &workers, Array<AutoPtr<PHYSICS>> &worlds, uint32_t num_steps) {
+				workers.run(worlds.size(), [&worlds, num_steps](uint32_t index) {
+					for(uint32_t i = 0; i < num_steps; i++) worlds[index]->update();
+				});
+			}
+			
+			// worlds benchmark
+			// the scene bodies, shapes, and joints are the read-only source of every world
+			// each world creates its own backend bodies and shapes and never writes back to the scene
+			void benchmark_worlds() {
+				
+				static const uint32_t num_worlds[] = { 1, 2, 4, 8, 16 };
+				const uint32_t num_steps = 256;
+				
+				Scene scene = getScene();
+				uint32_t max_threads = clamp(std::thread::hardware_concurrency(), 1u, (uint32_t)MaxThreads);
+				for(uint32_t worlds_count : num_worlds) {
+					
+					// create worlds
+					uint64_t begin = Time::current();
+					Array<AutoPtr<PHYSICS>> worlds(worlds_count);
+					for(AutoPtr<PHYSICS> &world : worlds) {
+						world = makeAutoPtr(new PHYSICS());
+						world->create(scene);
+					}
+					uint64_t create_time = Time::current() - begin;
+					
+					// step worlds
+					// threads are created before the measurement
+					for(uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+						WorkerPool workers;
+						workers.create(num_threads);
+						begin = Time::current();
+						step_worlds(workers, worlds, num_steps);
+						float64_t time = (Time::current() - begin) / 1e6;
+						TS_LOGF(Message, "GraphPhysics::benchmark_worlds(): %2u worlds %2u threads: %.0f world-steps/s (create %s)\n", worlds_count, num_threads, worlds_count * num_steps / time, String::fromTime(create_time).get());
+						if(num_threads >= worlds_count) break;
+					}
+				}
+			}
+			
+		#endif
+		
+		// write back body transforms
+		void sync_physics(Scene &scene) {
+			TRACE_ZONE("GraphPhysics::sync");
+			physics->update(scene);
+			
+			// record body transforms
+			#if RECORD_TRANSFORMS
+				for(uint32_t i = 0; i < body_nodes.size(); i++) {
+					TransformStream::get_rows(body_nodes[i].getGlobalTransform(), recorder_transforms.get() + i * 12);
+				}
+				recorder.record(scene.getTime(), recorder_transforms.get());
+			#endif
+		}
+		
+		/* spawn parameters
+		 * box shapes are created for positive density
+		 */
+		struct SpawnBody {
+			Matrix4x3d transform;
+			Vector3f velocity = Vector3f(0.0f);
+			float32_t density = 0.0f;
+			float32_t friction = 0.5f;
+		};
+		
+		/* deferred graph update
+		 * spatial and scene updates are done once at the end of the scope
+		 */
+		class DeferredUpdate {
+				
+			public:
+				
+				explicit DeferredUpdate(Graph &graph) : graph(graph) { }
+				~DeferredUpdate() {
+					graph.updateSpatial();
+					graph.updateScene();
+				}
+				
+			private:
+				
+				Graph &graph;
+		};
+		
+		// spawn bodies
+		void spawn_bodies(Scene &scene, Object &object, const SpawnBody *spawn_bodies, uint32_t num_bodies) {
+			bodies.reserve(bodies.size() + num_bodies);
+			for(uint32_t i = 0; i < num_bodies; i++) {
+				const SpawnBody &spawn_body = spawn_bodies[i];
+				BodyRigid body = BodyRigid(scene);
+				NodeObject node = NodeObject(*this, object, body);
+				body_nodes.append(node);
+				node.setGlobalTransform(spawn_body.transform);
+				if(spawn_body.density > 0.0f) {
+					ShapeBox shape = ShapeBox(body);
+					shape.setDensity(spawn_body.density);
+					shape.setFriction(spawn_body.friction);
+				}
+				body.setLinearVelocity(spawn_body.velocity);
+				node.setInternal(true);
+				body.setInternal(true);
+				bodies.append(body);
+			}
+		}
+		
+		#if BENCHMARK_SPAWN
+			
+			// spawn benchmark
+			// the per-body update is only measured for the smallest batch
+			void benchmark_spawn(Scene &scene, Object &object) {
+				
+				static const uint32_t counts[] = { 1000, 10000, 100000 };
+				
+				for(uint32_t count : counts) {
+					Array<SpawnBody> batch(count);
+					uint32_t size = (uint32_t)ceil(sqrt((float64_t)count));
+					for(uint32_t i = 0; i < count; i++) {
+						batch[i].transform = Matrix4x3d::translate(Vector3d((i % size) * 1.2, (i / size) * 1.2, 100.0));
+					}
+					
+					// per-body update
+					uint64_t single_time = 0;
+					if(count == counts[0]) {
+						uint64_t begin = Time::current();
+						for(const SpawnBody &spawn_body : batch) {
+							DeferredUpdate deferred_update(*this);
+							spawn_bodies(scene, object, &spawn_body, 1);
+						}
+						single_time = Time::current() - begin;
+						releaseNodes();
+						bodies.clear();
+						body_nodes.clear();
+						updateScene();
+					}
+					
+					// batched update
+					uint64_t begin = Time::current();
+					{
+						DeferredUpdate deferred_update(*this);
+						spawn_bodies(scene, object, batch.get(), batch.size());
+					}
+					uint64_t batch_time = Time::current() - begin;
+					releaseNodes();
+					bodies.clear();
+					body_nodes.clear();
+					updateScene();
+					
+					TS_LOGF(Message, "GraphPhysics::benchmark_spawn(): %u bodies batch %s single %s\n", count, String::fromTime(batch_time).get(), (single_time) ? String::fromTime(single_time).get() : "-");
+				}
+			}
+			
+		#endif
+		
 		// create scene
 		void create() {
 			
@@ -108,42 +623,43 @@ class GraphPhysics: public GraphScript {
 			Object object = scene.getObject("Box 1x1x1");
 			if(!object) return;
 			
+			#if BENCHMARK_SPAWN
+				benchmark_spawn(scene, object);
+			#endif
+			
+			// graph is updated once
+			DeferredUpdate deferred_update(*this);
+			
 			// create piramid
 			uint32_t piramid_size = 20;
+			Array<SpawnBody> piramid_bodies;
 			for(uint32_t z = 0; z <= piramid_size; z++) {
 				for(uint32_t y = 0; y <= z; y++) {
 					for(uint32_t x = 0; x <= z; x++) {
-						BodyRigid body = BodyRigid(scene);
-						NodeObject node = NodeObject(*this, object, body);
-						node.setGlobalTransform(Matrix4x3d::translate(Vector3d(x - z * 0.5, y - z * 0.5, piramid_size - z) * 1.2 + Vector3d(-40.0, 0.0, 1.0)));
-						node.setInternal(true);
-						body.setInternal(true);
+						SpawnBody body;
+						body.transform = Matrix4x3d::translate(Vector3d(x - z * 0.5, y - z * 0.5, piramid_size - z) * 1.2 + Vector3d(-40.0, 0.0, 1.0));
+						piramid_bodies.append(body);
 					}
 				}
 			}
+			spawn_bodies(scene, object, piramid_bodies.get(), piramid_bodies.size());
 			
 			object = scene.getObject("Box Mesh");
 			if(!object) return;
 			
 			// create friction
 			uint32_t friction_size = 10;
+			Array<SpawnBody> friction_bodies(friction_size * friction_size);
 			for(uint32_t y = 0; y < friction_size; y++) {
 				for(uint32_t x = 0; x < friction_size; x++) {
-					BodyRigid body = BodyRigid(scene);
-					NodeObject node = NodeObject(*this, object, body);
-					node.setGlobalTransform(Matrix4x3d::translate(Vector3d(x * 1.2, y * 1.2, 0.0) + Vector3d(-20.0, -20.0, 0.5)));
-					ShapeBox shape = ShapeBox(body);
-					shape.setDensity(1.0f);
-					shape.setFriction(1.0f - (float32_t)(friction_size * x + y) / (friction_size * friction_size));
-					body.setLinearVelocity(Vector3f(0.0f, 16.0f, 0.0f));
-					node.setInternal(true);
-					body.setInternal(true);
+					SpawnBody &body = friction_bodies[friction_size * y + x];
+					body.transform = Matrix4x3d::translate(Vector3d(x * 1.2, y * 1.2, 0.0) + Vector3d(-20.0, -20.0, 0.5));
+					body.velocity = Vector3f(0.0f, 16.0f, 0.0f);
+					body.density = 1.0f;
+					body.friction = 1.0f - (float32_t)(friction_size * x + y) / (friction_size * friction_size);
 				}
 			}
-			
-			// update graph
-			updateSpatial();
-			updateScene();
+			spawn_bodies(scene, object, friction_bodies.get(), friction_bodies.size());
 		}
 		
 		bool created = false;
@@ -153,4 +669,43 @@ class GraphPhysics: public GraphScript {
 		uint32_t simulation_frame = 0;
 		
 		AutoPtr<PHYSICS> physics;
+		
+		#if BENCHMARK_WORLDS
+			enum {
+				MaxThreads = 64,
+			};
+		#endif
+		
+		Array<BodyRigid> bodies;
+		Array<NodeObject> body_nodes;
+		
+		#if RECORD_TRANSFORMS
+			TransformRecorder recorder;
+			Array<float32_t> recorder_transforms;
+		#endif
+		#if REPLAY_TRANSFORMS
+			TransformReader reader;
+		#endif
+		
+		#if PHYSICS_RESET
+			float64_t reset_time = 0.0;
+			Array<BodyState> reset_snapshot;
+		#endif
+		
+		#if BENCHMARK_PHYSICS
+			bool benchmark_done = false;
+			size_t benchmark_memory = 0;
+		#endif
+		
+		#if PHYSICS_THREAD
+			enum {
+				MaxSteps = 4,
+			};
+			std::thread physics_thread;
+			std::mutex physics_mutex;
+			std::condition_variable physics_condition;
+			uint32_t physics_steps = 0;
+			bool physics_exit = false;
+			float64_t physics_time = 0.0;
+		#endif
 };
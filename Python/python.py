@@ -24,6 +24,30 @@ import math
 
 from tellusim import *
 
+# tellusim_ext views are filled by fetch() with the state at the start of the callbacks
+# commit() is applied immediately, or at the next frame when the module is built with PYTHON_THREAD
+try:
+	import tellusim_ext
+except ImportError:
+	tellusim_ext = None
+
+#
+# trace zone
+# zones are recorded when the host provides tellusim_ext and tracing is enabled
+#
+class TraceZone:
+	
+	def __init__(self, name):
+		self.name = name
+	
+	def __enter__(self):
+		if tellusim_ext: tellusim_ext.trace_begin(self.name)
+		return self
+	
+	def __exit__(self, type, value, traceback):
+		if tellusim_ext: tellusim_ext.trace_end()
+		return False
+
 #
 # scene
 #
@@ -34,6 +58,47 @@ sphere_mesh = None
 cylinder_mesh = None
 root_material = None
 
+#
+# deferred graph update
+# spatial and scene updates are done once when the outermost scope exits
+#
+deferred_depth = 0
+
+class DeferredUpdate:
+	
+	def __enter__(self):
+		global deferred_depth
+		deferred_depth += 1
+		return self
+	
+	def __exit__(self, type, value, traceback):
+		global deferred_depth
+		deferred_depth -= 1
+		if deferred_depth == 0: update_graph()
+		return False
+
+def update_graph():
+	graph.updateSpatial()
+	graph.updateScene()
+
+#
+# material cache
+# bodies with equal colors and sizes share the same material
+#
+materials = {}
+
+def get_material(size, color):
+	key = (size.x, size.y, size.z, color.r, color.g, color.b, color.a)
+	material = materials.get(key)
+	if material is None:
+		material = Material(parent = root_material)
+		material.setUniform('diffuse_0_color', color)
+		material.setUniform('diffuse_1_color', color * 0.3)
+		material.setUniform('grid_size', 1.0 / size)
+		material.setInternal(True)
+		materials[key] = material
+	return material
+
 #
 # create bodies
 #
@@ -55,17 +120,11 @@ def create_body(shape, mesh, size, transform, density, friction, restitution, co
 	node.setGlobalTransform(transform)
 	node.setInternal(True)
 	
-	# create material
-	material = Material(parent = root_material)
-	material.setUniform('diffuse_0_color', color)
-	material.setUniform('diffuse_1_color', color * 0.3)
-	material.setUniform('grid_size', 1.0 / size)
-	material.setInternal(True)
-	node.addMaterial(material)
+	# shared material
+	node.addMaterial(get_material(size, color))
 	
 	# update graph
-	graph.updateSpatial()
-	graph.updateScene()
+	if deferred_depth == 0: update_graph()
 	
 	return body
 
@@ -85,6 +144,27 @@ def create_cylinder(radius, height, transform, density = 1.0, friction = 0.5, re
 	shape.setHeight(height)
 	return create_body(shape, cylinder_mesh, Vector3f(radius, radius, height), transform, density, friction, restitution, color)
 
+#
+# create body batches
+# per-body parameters are scalars or lists with one value per transform
+#
+def create_batch(create_function, transforms, **parameters):
+	bodies = []
+	with DeferredUpdate():
+		for i, transform in enumerate(transforms):
+			arguments = { key: value[i] if isinstance(value, (list, tuple)) else value for key, value in parameters.items() }
+			bodies.append(create_function(transform = transform, **arguments))
+	return bodies
+
+def create_boxes(size, transforms, **parameters):
+	return create_batch(create_box, transforms, size = size, **parameters)
+
+def create_spheres(radius, transforms, **parameters):
+	return create_batch(create_sphere, transforms, radius = radius, **parameters)
+
+def create_cylinders(radius, height, transforms, **parameters):
+	return create_batch(create_cylinder, transforms, radius = radius, height = height, **parameters)
+
 #
 # create scene
 #
@@ -98,6 +178,7 @@ def create(s):
 	global root_material
 	
 	scene = s
+	materials.clear()
 	
 	# get resources
 	graph = scene.getGraph('Graph')
@@ -107,22 +188,70 @@ def create(s):
 	root_material = scene.getMaterial('Checkerboard Material')
 	
 	# create scene
-	create_cylinder(0.2, 2.0, Matrix4x3d.translate(0.0, 0.0, 0.2) * Matrix4x3d.rotateX(90.0), density = 10.0)
-	create_box(Vector3f(8.0, 1.0, 0.3), Matrix4x3d.translate(0.0, 0.0, 0.6))
-	
-	for z in range(0, 7):
-		create_cylinder(0.5, 1.0, Matrix4x3d.translate(-3.0 + z, 0.0, 2.0) * Matrix4x3d.rotateX(90.0), color = Color(0.1, 1.0, 0.1))
-	
-	create_box(Vector3f(1.0), Matrix4x3d.translate(-3.0, 0.0, 4.0), color = Color(1.0, 0.1, 0.1))
-	
-	create_sphere(0.75, Matrix4x3d.translate(3.0, 0.0, 8.0), density = 10.0, color = Color.red)
-	
-	for x in range(0, 40):
-		for z in range(0, x + 1):
-			k = x * 0.17 + z * 0.13
-			create_box(Vector3f(0.5), Matrix4x3d.translate(Vector3d(x - z * 0.5 - 20.0, 16.0, z + 1.0) * 0.5), color = Color(math.cos(k), 1.0, math.cos(k + 0.7)) * 0.4 + 0.6)
-	
-	for x in range(0, 20):
-		for z in range(0, x + 1):
-			k = x * 0.17 + z * 0.13
-			create_cylinder(0.25, 0.5, Matrix4x3d.translate(Vector3d(x - z * 0.5 - 10.0, 8.0, z + 1.0) * 0.5), color = Color(math.cos(k), math.cos(k + 0.3), 1.0) * 0.4 + 0.6)
+	with TraceZone('create'), DeferredUpdate():
+		
+		create_cylinder(0.2, 2.0, Matrix4x3d.translate(0.0, 0.0, 0.2) * Matrix4x3d.rotateX(90.0), density = 10.0)
+		create_box(Vector3f(8.0, 1.0, 0.3), Matrix4x3d.translate(0.0, 0.0, 0.6))
+		
+		create_cylinders(0.5, 1.0, [ Matrix4x3d.translate(-3.0 + z, 0.0, 2.0) * Matrix4x3d.rotateX(90.0) for z in range(0, 7) ], color = Color(0.1, 1.0, 0.1))
+		
+		create_box(Vector3f(1.0), Matrix4x3d.translate(-3.0, 0.0, 4.0), color = Color(1.0, 0.1, 0.1))
+		
+		create_sphere(0.75, Matrix4x3d.translate(3.0, 0.0, 8.0), density = 10.0, color = Color.red)
+		
+		transforms = []
+		colors = []
+		for x in range(0, 40):
+			for z in range(0, x + 1):
+				k = x * 0.17 + z * 0.13
+				transforms.append(Matrix4x3d.translate(Vector3d(x - z * 0.5 - 20.0, 16.0, z + 1.0) * 0.5))
+				colors.append(Color(math.cos(k), 1.0, math.cos(k + 0.7)) * 0.4 + 0.6)
+		create_boxes(Vector3f(0.5), transforms, color = colors)
+		
+		transforms = []
+		colors = []
+		for x in range(0, 20):
+			for z in range(0, x + 1):
+				k = x * 0.17 + z * 0.13
+				transforms.append(Matrix4x3d.translate(Vector3d(x - z * 0.5 - 10.0, 8.0, z + 1.0) * 0.5))
+				colors.append(Color(math.cos(k), math.cos(k + 0.3), 1.0) * 0.4 + 0.6)
+		create_cylinders(0.25, 0.5, transforms, color = colors)
+
+#
+# binding benchmark callbacks
+#
+def benchmark_empty(s):
+	pass
+
+def benchmark_nodes(s):
+	for i in range(min(graph.getNumNodes(), 1000)):
+		graph.getNode(i).getGlobalTransform()
+
+#
+# move nodes through the tellusim_ext views
+# numpy moves all nodes with one vectorized operation when it is available
+#
+try:
+	import numpy
+except ImportError:
+	numpy = None
+
+def move_nodes(offset):
+	tellusim_ext.fetch()
+	transforms = tellusim_ext.transforms()
+	if numpy:
+		numpy.asarray(transforms)[:, 11] += offset
+	else:
+		for i in range(transforms.shape[0]):
+			transforms[i, 11] += offset
+	transforms.release()
+	tellusim_ext.commit()
+
+# the direction alternates, so an even number of calls leaves the nodes in place
+views_offset = 0.01
+
+def benchmark_views(s):
+	global views_offset
+	if tellusim_ext is None: return
+	move_nodes(views_offset)
+	views_offset = -views_offset
@@ -21,12 +21,39 @@
 // SOFTWARE.
 
 #include <core/TellusimLog.h>
+#include <core/TellusimTime.h>
 
 #include <binding/python/source/TellusimPyBase.cpp>
 #include <binding/python/source/TellusimPyMath.cpp>
 #include <binding/python/source/TellusimPyAPI.cpp>
 #include <system/python/source/TellusimPython.cpp>
 
+#include "../../Common/trace.h"
+
+/* binding benchmark
+ * per-call overhead of empty and node-touching Python callbacks
+ * benchmark_views moves every graph node through the tellusim_ext views and reports the per-node cost
+ */
+#ifndef BENCHMARK_PYTHON
+	#define BENCHMARK_PYTHON	0
+#endif
+
+/* python thread
+ * update and dispatch callbacks run on a dedicated thread holding the GIL
+ * tellusim_ext views are fetched at the sync point before the callbacks, so fetch() sees the same state as without the thread
+ * tellusim_ext commit records the changed entries which are applied at the next sync point, one frame later than without the thread
+ * the frame thread doesn't hold the GIL between callbacks
+ */
+#ifndef PYTHON_THREAD
+	#define PYTHON_THREAD		0
+#endif
+
+#if PYTHON_THREAD
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+#endif
+
 #pragma cflags($(shell python3-config --includes))
 #pragma ldflags($(shell python3-config --ldflags --libs --embed))
 
@@ -47,45 +74,555 @@ class GraphPython: public GraphScript {
 		~GraphPython() {
 			
 			TS_LOGF(Message, "GraphPython::~GraphPython(): %p\n", this);
+			
+			// stop python thread
+			#if PYTHON_THREAD
+				if(python_thread.joinable()) {
+					{
+						std::unique_lock<std::mutex> lock(python_mutex);
+						python_exit = true;
+					}
+					python_condition.notify_all();
+					python_thread.join();
+					PyEval_RestoreThread(thread_state);
+				}
+			#endif
+			
+			// release script references
+			if(python) {
+				Py_XDECREF(update_function);
+				Py_XDECREF(dispatch_function);
+				Py_XDECREF(scene_object);
+			}
+			
+			if(Trace::isEnabled() && !Trace::save("python_trace.json")) TS_LOG(Error, "GraphPython::~GraphPython(): can't save trace\n");
 		}
 		
 		/*
 		 */
 		virtual void update() {
 			
+			TRACE_ZONE("GraphPython::update");
+			
 			// load script
 			if(!initialized) {
 				initialized = true;
 				python = makeAutoPtr(new Python());
-				if(python->load("python")) {
+				create_module();
+				if(python->load(ScriptName)) {
+					
+					// entry points are resolved once
+					has_update = python->isFunction("update");
+					has_dispatch = python->isFunction("dispatch");
+					
+					// callbacks are called directly with the cached scene object
+					// the Python::run() path is used if the script module isn't found
+					resolve_functions(ScriptName);
+					
 					if(python->isFunction("create")) {
 						Scene scene = getScene();
 						python->run("create", scene);
 					}
+					
+					#if BENCHMARK_PYTHON
+						benchmark();
+					#endif
+					
+					// release the GIL for the python thread
+					// the first callbacks see fetched views
+					#if PYTHON_THREAD
+						fetch();
+						thread_state = PyEval_SaveThread();
+						python_thread = std::thread(&GraphPython::python_loop, this);
+					#endif
 				} else {
 					python.clear();
 				}
 			}
 			
-			// run update function
-			if(initialized && python && python->isFunction("update")) {
-				Scene scene = getScene();
-				python->run("update", scene);
-			}
+			#if PYTHON_THREAD
+				
+				// sync point
+				// recorded commits and the fetch for the next callbacks are applied while the python thread is idle
+				if(python_thread.joinable()) {
+					wait_python();
+					apply_commit();
+					if(fetch_enabled && !fetch() && !fetch_deferred) {
+						TS_LOG(Warning, "GraphPython::update(): fetch is deferred while views are exported\n");
+						fetch_deferred = true;
+					}
+					run_python();
+				}
+				
+			#else
+				
+				// run update function
+				if(has_update && python) {
+					run_function(update_function, "update");
+				}
+				
+			#endif
 		}
 		
 		virtual void dispatch() {
 			
+			TRACE_ZONE("GraphPython::dispatch");
+			
 			// run dispatch function
-			if(initialized && python && python->isFunction("dispatch")) {
-				Scene scene = getScene();
-				python->run("dispatch", scene);
-			}
+			// the python thread runs dispatch after update
+			#if !PYTHON_THREAD
+				if(has_dispatch && python) {
+					run_function(dispatch_function, "dispatch");
+				}
+			#endif
 		}
 		
 	private:
 		
+		/* transforms module
+		 * graph node transforms and body velocities as writable memory views
+		 * the arrays are not reallocated while views are exported
+		 * commit() records and applies only the entries which differ from the fetched values
+		 * with PYTHON_THREAD fetch() returns the state fetched before the callbacks
+		 * and commit() is applied at the next sync point instead of immediately
+		 */
+		void create_module() {
+			static PyMethodDef methods[] = {
+				{ "fetch", py_fetch, METH_NOARGS, "fetch node transforms and body velocities at the start of the callbacks" },
+				{ "commit", py_commit, METH_NOARGS, "commit changed node transforms and body velocities (applied at the next sync point with PYTHON_THREAD)" },
+				{ "transforms", py_transforms, METH_NOARGS, "node transforms view (num_nodes, 12)" },
+				{ "velocities", py_velocities, METH_NOARGS, "body velocities view (num_nodes, 6)" },
+				{ "trace_begin", py_trace_begin, METH_VARARGS, "begin trace zone" },
+				{ "trace_end", py_trace_end, METH_NOARGS, "end trace zone" },
+				{ "trace_enable", py_trace_enable, METH_VARARGS, "enable or disable tracing" },
+				{ "bind_scene", py_bind_scene, METH_O, "keep the scene object for direct callbacks" },
+				{ nullptr, nullptr, 0, nullptr },
+			};
+			static PyModuleDef module_def = {
+				PyModuleDef_HEAD_INIT, "tellusim_ext", "Graph node transforms", sizeof(GraphPython*), methods,
+			};
+			if(!(view_type.tp_flags & Py_TPFLAGS_READY)) {
+				view_type.tp_name = "tellusim_ext.View";
+				view_type.tp_basicsize = sizeof(ViewObject);
+				view_type.tp_flags = Py_TPFLAGS_DEFAULT;
+				view_type.tp_doc = "node transforms or body velocities buffer";
+				view_type.tp_as_buffer = &view_buffer_procs;
+				if(PyType_Ready(&view_type) < 0) {
+					TS_LOG(Error, "GraphPython::create_module(): can't create view type\n");
+					return;
+				}
+			}
+			PyObject *module = PyModule_Create(&module_def);
+			if(!module) {
+				TS_LOG(Error, "GraphPython::create_module(): can't create module\n");
+				return;
+			}
+			*(GraphPython**)PyModule_GetState(module) = this;
+			PyDict_SetItemString(PyImport_GetModuleDict(), "tellusim_ext", module);
+			Py_DECREF(module);
+		}
+		
+		static GraphPython *get_instance(PyObject *module) {
+			return *(GraphPython**)PyModule_GetState(module);
+		}
+		
+		static PyObject *py_fetch(PyObject *module, PyObject *args) {
+			GraphPython *self = get_instance(module);
+			#if PYTHON_THREAD
+				if(self->python_thread.joinable()) {
+					self->fetch_enabled = true;
+					Py_RETURN_NONE;
+				}
+			#endif
+			if(!self->fetch()) {
+				PyErr_SetString(PyExc_BufferError, "the number of nodes has changed while views are exported");
+				return nullptr;
+			}
+			Py_RETURN_NONE;
+		}
+		static PyObject *py_commit(PyObject *module, PyObject *args) {
+			GraphPython *self = get_instance(module);
+			self->record_commit();
+			#if PYTHON_THREAD
+				if(self->python_thread.joinable()) Py_RETURN_NONE;
+			#endif
+			self->apply_commit();
+			Py_RETURN_NONE;
+		}
+		static PyObject *py_transforms(PyObject *module, PyObject *args) {
+			return create_view(get_instance(module), ViewTransforms);
+		}
+		static PyObject *py_velocities(PyObject *module, PyObject *args) {
+			return create_view(get_instance(module), ViewVelocities);
+		}
+		
+		// trace zones
+		// zone names are interned once per distinct string
+		static PyObject *py_trace_begin(PyObject *module, PyObject *args) {
+			const char *name = nullptr;
+			if(!PyArg_ParseTuple(args, "s", &name)) return nullptr;
+			if(Trace::isEnabled()) Trace::begin(Trace::intern(name));
+			Py_RETURN_NONE;
+		}
+		static PyObject *py_trace_end(PyObject *module, PyObject *args) {
+			if(Trace::isEnabled()) Trace::end();
+			Py_RETURN_NONE;
+		}
+		static PyObject *py_trace_enable(PyObject *module, PyObject *args) {
+			int enabled = 1;
+			if(!PyArg_ParseTuple(args, "p", &enabled)) return nullptr;
+			Trace::setEnabled(enabled != 0);
+			Py_RETURN_NONE;
+		}
+		
+		// scene object
+		static PyObject *py_bind_scene(PyObject *module, PyObject *scene) {
+			GraphPython *self = get_instance(module);
+			Py_INCREF(scene);
+			Py_XDECREF(self->scene_object);
+			self->scene_object = scene;
+			Py_RETURN_NONE;
+		}
+		
+		/* script callbacks
+		 * functions are resolved once in the script module dictionary
+		 * the scene object is wrapped once by passing it through Python::run()
+		 * the scene is bound even if the script has no update or dispatch function
+		 */
+		void resolve_functions(const char *name) {
+			
+			// script module
+			PyObject *dict = get_script_dict(name);
+			if(!dict) {
+				TS_LOG(Warning, "GraphPython::resolve_functions(): can't find script module\n");
+				return;
+			}
+			update_function = get_function(dict, "update");
+			dispatch_function = get_function(dict, "dispatch");
+			
+			// wrapped scene
+			PyObject *module = PyDict_GetItemString(PyImport_GetModuleDict(), "tellusim_ext");
+			PyObject *bind_scene = (module) ? PyObject_GetAttrString(module, "bind_scene") : nullptr;
+			if(bind_scene) {
+				PyDict_SetItemString(dict, "_tellusim_bind_scene", bind_scene);
+				python->run("_tellusim_bind_scene", getScene());
+				PyDict_DelItemString(dict, "_tellusim_bind_scene");
+				Py_DECREF(bind_scene);
+			}
+			PyErr_Clear();
+			if(!scene_object) TS_LOG(Warning, "GraphPython::resolve_functions(): can't bind scene object\n");
+		}
+		
+		// the script module is registered under the loaded name
+		static PyObject *get_script_dict(const char *name) {
+			PyObject *module = PyDict_GetItemString(PyImport_GetModuleDict(), name);
+			if(!module || !PyModule_Check(module)) return nullptr;
+			return PyModule_GetDict(module);
+		}
+		
+		static PyObject *get_function(PyObject *dict, const char *name) {
+			PyObject *function = PyDict_GetItemString(dict, name);
+			if(!function || !PyCallable_Check(function)) return nullptr;
+			Py_INCREF(function);
+			return function;
+		}
+		
+		// run script callback
+		void run_function(PyObject *function, const char *name) {
+			if(function && scene_object) {
+				PyObject *ret = PyObject_CallFunctionObjArgs(function, scene_object, nullptr);
+				if(ret) Py_DECREF(ret);
+				else PyErr_Print();
+			} else {
+				python->run(name, getScene());
+			}
+		}
+		
+		/* buffer object
+		 * memory views and arrays created from the view keep the buffer exported
+		 */
+		enum {
+			ViewTransforms = 0,
+			ViewVelocities,
+		};
+		struct ViewObject {
+			PyObject_HEAD
+			GraphPython *self;
+			uint32_t type;
+			Py_ssize_t shape[2];
+			Py_ssize_t strides[2];
+		};
+		
+		static PyObject *create_view(GraphPython *self, uint32_t type) {
+			ViewObject *view = PyObject_New(ViewObject, &view_type);
+			if(!view) return nullptr;
+			view->self = self;
+			view->type = type;
+			PyObject *ret = PyMemoryView_FromObject((PyObject*)view);
+			Py_DECREF(view);
+			return ret;
+		}
+		
+		// two-dimensional writable buffer
+		static int view_get_buffer(PyObject *object, Py_buffer *buffer, int flags) {
+			ViewObject *view = (ViewObject*)object;
+			GraphPython *self = view->self;
+			bool transforms = (view->type == ViewTransforms);
+			uint32_t size = (transforms) ? sizeof(float64_t) : sizeof(float32_t);
+			uint32_t stride = (transforms) ? 12 : 6;
+			void *data = (transforms) ? (void*)self->transforms.get() : (void*)self->velocities.get();
+			view->shape[0] = self->nodes.size();
+			view->shape[1] = stride;
+			view->strides[0] = size * stride;
+			view->strides[1] = size;
+			buffer->obj = object;
+			buffer->buf = (data) ? data : (void*)view->strides;
+			buffer->len = view->shape[0] * view->strides[0];
+			buffer->readonly = 0;
+			buffer->itemsize = size;
+			buffer->format = (flags & PyBUF_FORMAT) ? (char*)((transforms) ? "d" : "f") : nullptr;
+			buffer->ndim = (flags & PyBUF_ND) ? 2 : 1;
+			buffer->shape = (flags & PyBUF_ND) ? view->shape : nullptr;
+			buffer->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? view->strides : nullptr;
+			buffer->suboffsets = nullptr;
+			buffer->internal = nullptr;
+			Py_INCREF(object);
+			self->num_exports++;
+			return 0;
+		}
+		static void view_release_buffer(PyObject *object, Py_buffer *buffer) {
+			((ViewObject*)object)->self->num_exports--;
+		}
+		
+		static PyBufferProcs view_buffer_procs;
+		static PyTypeObject view_type;
+		
+		// fetch node transforms
+		// returns false when the arrays can't be reallocated because views are exported
+		bool fetch() {
+			
+			// graph nodes
+			uint32_t num_nodes = getNumNodes();
+			if(nodes.size() != num_nodes) {
+				if(num_exports) return false;
+				nodes.resize(num_nodes);
+				bodies.resize(num_nodes);
+				transforms.resize(num_nodes * 12);
+				velocities.resize(num_nodes * 6);
+				fetched_transforms.resize(num_nodes * 12);
+				fetched_velocities.resize(num_nodes * 6);
+			}
+			for(uint32_t i = 0; i < num_nodes; i++) {
+				nodes[i] = getNode(i);
+				NodeObject node_object = NodeObject(nodes[i]);
+				bodies[i] = (node_object) ? BodyRigid(node_object.getBody()) : BodyRigid();
+			}
+			
+			// node transforms and body velocities
+			for(uint32_t i = 0; i < num_nodes; i++) {
+				float64_t *transform = transforms.get() + i * 12;
+				Matrix4x3d matrix = nodes[i].getGlobalTransform();
+				transform[0] = matrix.m00; transform[1] = matrix.m01; transform[2] = matrix.m02; transform[3] = matrix.m03;
+				transform[4] = matrix.m10; transform[5] = matrix.m11; transform[6] = matrix.m12; transform[7] = matrix.m13;
+				transform[8] = matrix.m20; transform[9] = matrix.m21; transform[10] = matrix.m22; transform[11] = matrix.m23;
+				float32_t *velocity = velocities.get() + i * 6;
+				Vector3f linear_velocity = (bodies[i]) ? bodies[i].getLinearVelocity() : Vector3f(0.0f);
+				Vector3f angular_velocity = (bodies[i]) ? bodies[i].getAngularVelocity() : Vector3f(0.0f);
+				velocity[0] = linear_velocity.x; velocity[1] = linear_velocity.y; velocity[2] = linear_velocity.z;
+				velocity[3] = angular_velocity.x; velocity[4] = angular_velocity.y; velocity[5] = angular_velocity.z;
+			}
+			
+			// changes are detected against the fetched values
+			memcpy(fetched_transforms.get(), transforms.get(), transforms.bytes());
+			memcpy(fetched_velocities.get(), velocities.get(), velocities.bytes());
+			
+			return true;
+		}
+		
+		// record changed node transforms and body velocities
+		// the fetched values are updated, so every change is recorded once
+		void record_commit() {
+			for(uint32_t i = 0; i < nodes.size(); i++) {
+				const float64_t *transform = transforms.get() + i * 12;
+				const float32_t *velocity = velocities.get() + i * 6;
+				float64_t *fetched_transform = fetched_transforms.get() + i * 12;
+				float32_t *fetched_velocity = fetched_velocities.get() + i * 6;
+				uint32_t flags = 0;
+				if(memcmp(transform, fetched_transform, sizeof(float64_t) * 12) != 0) flags |= CommitTransform;
+				if(memcmp(velocity, fetched_velocity, sizeof(float32_t) * 3) != 0) flags |= CommitLinearVelocity;
+				if(memcmp(velocity + 3, fetched_velocity + 3, sizeof(float32_t) * 3) != 0) flags |= CommitAngularVelocity;
+				if(flags == 0) continue;
+				CommitCommand command;
+				command.index = i;
+				command.flags = flags;
+				memcpy(command.transform, transform, sizeof(float64_t) * 12);
+				memcpy(command.velocity, velocity, sizeof(float32_t) * 6);
+				commands.append(command);
+				memcpy(fetched_transform, transform, sizeof(float64_t) * 12);
+				memcpy(fetched_velocity, velocity, sizeof(float32_t) * 6);
+			}
+		}
+		
+		// apply recorded changes
+		// untouched bodies are not woken and keep their simulated velocities
+		// the graph is updated once
+		void apply_commit() {
+			bool changed = false;
+			for(const CommitCommand &command : commands) {
+				if(command.flags & CommitTransform) {
+					nodes[command.index].setGlobalTransform(get_matrix(command.transform));
+					changed = true;
+				}
+				BodyRigid &body = bodies[command.index];
+				if(!body) continue;
+				const float32_t *velocity = command.velocity;
+				if(command.flags & CommitLinearVelocity) body.setLinearVelocity(Vector3f(velocity[0], velocity[1], velocity[2]));
+				if(command.flags & CommitAngularVelocity) body.setAngularVelocity(Vector3f(velocity[3], velocity[4], velocity[5]));
+			}
+			commands.clear();
+			if(changed) {
+				updateSpatial();
+				updateScene();
+			}
+		}
+		
+		static Matrix4x3d get_matrix(const float64_t *transform) {
+			Matrix4x3d ret;
+			ret.m00 = transform[0]; ret.m01 = transform[1]; ret.m02 = transform[2]; ret.m03 = transform[3];
+			ret.m10 = transform[4]; ret.m11 = transform[5]; ret.m12 = transform[6]; ret.m13 = transform[7];
+			ret.m20 = transform[8]; ret.m21 = transform[9]; ret.m22 = transform[10]; ret.m23 = transform[11];
+			return ret;
+		}
+		
+		#if BENCHMARK_PYTHON
+			
+			// binding benchmark
+			void benchmark() {
+				
+				const uint32_t num_calls = 10000;
+				
+				// function lookup
+				uint64_t begin = Time::current();
+				uint32_t num_functions = 0;
+				for(uint32_t i = 0; i < num_calls; i++) num_functions += python->isFunction("update");
+				float64_t lookup_time = (Time::current() - begin) * 1000.0 / num_calls;
+				TS_LOGF(Message, "GraphPython::benchmark(): lookup %.1f ns/call\n", lookup_time);
+				
+				// callbacks
+				Scene scene = getScene();
+				static const char *functions[] = { "benchmark_empty", "benchmark_nodes", "benchmark_views" };
+				for(const char *name : functions) {
+					if(!python->isFunction(name)) continue;
+					begin = Time::current();
+					for(uint32_t i = 0; i < num_calls; i++) python->run(name, scene);
+					float64_t call_time = (Time::current() - begin) * 1000.0 / num_calls;
+					TS_LOGF(Message, "GraphPython::benchmark(): %s %.1f ns/call\n", name, call_time);
+					if(!strcmp(name, "benchmark_views") && getNumNodes()) TS_LOGF(Message, "GraphPython::benchmark(): %s %u nodes %.1f ns/node\n", name, getNumNodes(), call_time / getNumNodes());
+					
+					// direct call with the cached function and scene object
+					PyObject *dict = get_script_dict(ScriptName);
+					PyObject *function = (dict) ? get_function(dict, name) : nullptr;
+					if(!function || !scene_object) {
+						Py_XDECREF(function);
+						continue;
+					}
+					begin = Time::current();
+					for(uint32_t i = 0; i < num_calls; i++) run_function(function, name);
+					float64_t direct_time = (Time::current() - begin) * 1000.0 / num_calls;
+					TS_LOGF(Message, "GraphPython::benchmark(): %s direct %.1f ns/call (%.1fx)\n", name, direct_time, call_time / max(direct_time, 1e-3));
+					Py_DECREF(function);
+				}
+			}
+			
+		#endif
+		
+		#if PYTHON_THREAD
+			
+			// python thread loop
+			void python_loop() {
+				std::unique_lock<std::mutex> lock(python_mutex);
+				while(true) {
+					python_condition.wait(lock, [this] { return (python_running || python_exit); });
+					if(python_exit) break;
+					lock.unlock();
+					PyGILState_STATE state = PyGILState_Ensure();
+					{
+						TRACE_ZONE("GraphPython::callbacks");
+						if(has_update) run_function(update_function, "update");
+						if(has_dispatch) run_function(dispatch_function, "dispatch");
+					}
+					PyGILState_Release(state);
+					lock.lock();
+					python_running = false;
+					python_condition.notify_all();
+				}
+			}
+			
+			// run python callbacks
+			void run_python() {
+				if(!has_update && !has_dispatch) return;
+				{
+					std::unique_lock<std::mutex> lock(python_mutex);
+					python_running = true;
+				}
+				python_condition.notify_all();
+			}
+			
+			// wait for python callbacks
+			void wait_python() {
+				std::unique_lock<std::mutex> lock(python_mutex);
+				python_condition.wait(lock, [this] { return !python_running; });
+			}
+			
+		#endif
+		
+		// script module name
+		static constexpr const char *ScriptName = "python";
+		
 		bool initialized = false;
+		bool has_update = false;
+		bool has_dispatch = false;
 		
 		AutoPtr<Python> python;
+		PyObject *update_function = nullptr;
+		PyObject *dispatch_function = nullptr;
+		PyObject *scene_object = nullptr;
+		
+		Array<Node> nodes;
+		Array<BodyRigid> bodies;
+		Array<float64_t> transforms;
+		Array<float32_t> velocities;
+		Array<float64_t> fetched_transforms;
+		Array<float32_t> fetched_velocities;
+		uint32_t num_exports = 0;
+		
+		// recorded commit
+		enum {
+			CommitTransform			= (1 << 0),
+			CommitLinearVelocity	= (1 << 1),
+			CommitAngularVelocity	= (1 << 2),
+		};
+		struct CommitCommand {
+			uint32_t index;
+			uint32_t flags;
+			float64_t transform[12];
+			float32_t velocity[6];
+		};
+		Array<CommitCommand> commands;
+		
+		#if PYTHON_THREAD
+			std::thread python_thread;
+			std::mutex python_mutex;
+			std::condition_variable python_condition;
+			PyThreadState *thread_state = nullptr;
+			bool python_running = false;
+			bool python_exit = false;
+			bool fetch_enabled = false;
+			bool fetch_deferred = false;
+		#endif
 };
+
+/*
+ */
+PyBufferProcs GraphPython::view_buffer_procs = { GraphPython::view_get_buffer, GraphPython::view_release_buffer };
+PyTypeObject GraphPython::view_type = { PyVarObject_HEAD_INIT(nullptr, 0) };